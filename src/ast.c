@@ -11,9 +11,12 @@
 
 bool astFrame(Value root);
 bool astClosure(Value* enclosing, ObjClosure* closure, ObjClass* closureClass);
-bool astLocal(uint8_t slot, ObjFunction* function);
+bool astLocal(CallFrame* frame, uint8_t slot);
 bool astFrame(Value root);
 bool astGlobal(ObjString* name);
+bool astSetLocal(CallFrame* frame, Value root, uint16_t slot);
+bool astSetGlobal(Value root, ObjString* name);
+bool astGetProperty(Value root, Value key);
 bool astOverload(ObjOverload* overload);
 bool astChunk(CallFrame* frame, uint8_t* ipEnd, Value root);
 bool astBlock(Value* enclosing);
@@ -42,40 +45,112 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
     vmPush(value);                 \
   } while (0)
 
-  switch (instruction) {
-    case OP_UNDEFINED: {
+#ifdef COMPUTED_GOTO
+  // opcodes without an entry fall through to [L_UNHANDLED].
+  static void* dispatchTable[UINT8_COUNT] = {
+      [OP_UNDEFINED] = &&L_OP_UNDEFINED,
+      [OP_CONSTANT] = &&L_OP_CONSTANT,
+      [OP_NIL] = &&L_OP_NIL,
+      [OP_TRUE] = &&L_OP_TRUE,
+      [OP_FALSE] = &&L_OP_FALSE,
+      [OP_NOT] = &&L_OP_NOT,
+      [OP_EXPR_STATEMENT] = &&L_OP_EXPR_STATEMENT,
+      [OP_POP] = &&L_OP_POP,
+      [OP_RETURN] = &&L_OP_RETURN,
+      [OP_IMPLICIT_RETURN] = &&L_OP_IMPLICIT_RETURN,
+      [OP_JUMP] = &&L_OP_JUMP,
+      [OP_JUMP_IF_FALSE] = &&L_OP_JUMP_IF_FALSE,
+      [OP_ITER] = &&L_OP_ITER,
+      [OP_LOOP] = &&L_OP_LOOP,
+      [OP_GET_GLOBAL] = &&L_OP_GET_GLOBAL,
+      [OP_DEFINE_GLOBAL] = &&L_OP_DEFINE_GLOBAL,
+      [OP_SET_GLOBAL] = &&L_OP_SET_GLOBAL,
+      [OP_GET_LOCAL] = &&L_OP_GET_LOCAL,
+      [OP_SET_LOCAL] = &&L_OP_SET_LOCAL,
+      [OP_GET_UPVALUE] = &&L_OP_GET_UPVALUE,
+      [OP_GET_PROPERTY] = &&L_OP_GET_PROPERTY,
+      [OP_SET_PROPERTY] = &&L_OP_SET_PROPERTY,
+      [OP_SUBSCRIPT_GET] = &&L_OP_SUBSCRIPT_GET,
+      [OP_SUBSCRIPT_SET] = &&L_OP_SUBSCRIPT_SET,
+      [OP_EQUAL] = &&L_OP_EQUAL,
+      [OP_VARIABLE] = &&L_OP_VARIABLE,
+      [OP_CLOSE_UPVALUE] = &&L_OP_CLOSE_UPVALUE,
+      [OP_SIGN] = &&L_OP_SIGN,
+      [OP_OVERLOAD] = &&L_OP_OVERLOAD,
+      [OP_CLOSURE] = &&L_OP_CLOSURE,
+      [OP_COMPREHENSION] = &&L_OP_COMPREHENSION,
+      [OP_COMPREHENSION_PRED] = &&L_OP_COMPREHENSION_PRED,
+      [OP_COMPREHENSION_ITER] = &&L_OP_COMPREHENSION_ITER,
+      [OP_COMPREHENSION_BODY] = &&L_OP_COMPREHENSION_BODY,
+      [OP_CALL] = &&L_OP_CALL,
+      [OP_INVOKE] = &&L_OP_INVOKE,
+      [OP_CALL_INFIX] = &&L_OP_CALL_INFIX,
+      [OP_ADD] = &&L_OP_ADD,
+      [OP_SUB] = &&L_OP_SUB,
+      [OP_MUL] = &&L_OP_MUL,
+      [OP_DIV] = &&L_OP_DIV,
+      [OP_LT] = &&L_OP_LT,
+      [OP_GT] = &&L_OP_GT,
+      [OP_LTE] = &&L_OP_LTE,
+      [OP_GTE] = &&L_OP_GTE,
+      [OP_CALL_POSTFIX] = &&L_OP_CALL_POSTFIX,
+      [OP_MEMBER] = &&L_OP_MEMBER,
+      [OP_THROW] = &&L_OP_THROW,
+      [OP_IMPORT] = &&L_OP_IMPORT,
+      [OP_IMPORT_AS] = &&L_OP_IMPORT_AS,
+      [OP_SET_TYPE_LOCAL] = &&L_OP_SET_TYPE_LOCAL,
+      [OP_SET_TYPE_GLOBAL] = &&L_OP_SET_TYPE_GLOBAL,
+      [OP_UNIT] = &&L_OP_UNIT,
+      [OP_POPN] = &&L_OP_POPN,
+      [OP_SET_LOCAL_POP] = &&L_OP_SET_LOCAL_POP,
+      [OP_SET_GLOBAL_POP] = &&L_OP_SET_GLOBAL_POP,
+      [OP_GET_LOCAL_PROPERTY] = &&L_OP_GET_LOCAL_PROPERTY,
+      [OP_TAIL_CALL] = &&L_OP_TAIL_CALL,
+      [OP_TAIL_INVOKE] = &&L_OP_TAIL_INVOKE,
+      [OP_QUANTIFY] = &&L_OP_QUANTIFY,
+  };
+
+#define CASE(op) L_##op
+  if (dispatchTable[instruction] == NULL) goto L_UNHANDLED;
+  goto* dispatchTable[instruction];
+#else
+#define CASE(op) case op
+  switch (instruction)
+#endif
+  {
+    CASE(OP_UNDEFINED): {
       vmPush(root);
       vmPush(UNDEF_VAL);
 
       OK_IF(vmExecuteMethod("opLiteral", 1));
     }
-    case OP_CONSTANT: {
+    CASE(OP_CONSTANT): {
       vmPush(root);
       vmPush(READ_CONSTANT());
       OK_IF(vmExecuteMethod("opLiteral", 1));
     }
-    case OP_NIL: {
+    CASE(OP_NIL): {
       vmPush(root);
       vmPush(NIL_VAL);
       OK_IF(vmExecuteMethod("opLiteral", 1));
     }
-    case OP_TRUE: {
+    CASE(OP_TRUE): {
       vmPush(root);
       vmPush(BOOL_VAL(true));
       OK_IF(vmExecuteMethod("opLiteral", 1));
     }
-    case OP_FALSE: {
+    CASE(OP_FALSE): {
       vmPush(root);
       vmPush(BOOL_VAL(false));
       OK_IF(vmExecuteMethod("opLiteral", 1));
     }
-    case OP_NOT: {
+    CASE(OP_NOT): {
       Value value = vmPop();
       vmPush(root);
       vmPush(value);
       OK_IF(vmExecuteMethod("opNot", 1));
     }
-    case OP_EXPR_STATEMENT: {
+    CASE(OP_EXPR_STATEMENT): {
       Value value = vmPop();
       vmPush(root);
       vmPush(value);
@@ -84,24 +159,27 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPop();  // nil.
       return AST_INSTRUCTION_OK;
     }
-    case OP_POP:
+    CASE(OP_POP):
       vmPop();
       return AST_INSTRUCTION_OK;
-    case OP_RETURN: {
+    CASE(OP_POPN):
+      vm.stackTop -= READ_BYTE();
+      return AST_INSTRUCTION_OK;
+    CASE(OP_RETURN): {
       RETURN();
 
       FAIL_UNLESS(vmExecuteMethod("opReturn", 1));
       vmPop();  // nil.
       return AST_INSTRUCTION_OK;
     }
-    case OP_IMPLICIT_RETURN: {
+    CASE(OP_IMPLICIT_RETURN): {
       RETURN();
 
       FAIL_UNLESS(vmExecuteMethod("opImplicitReturn", 1));
       vmPop();  // nil.
       return AST_INSTRUCTION_COMPLETE;
     }
-    case OP_JUMP: {
+    CASE(OP_JUMP): {
       uint16_t offset = READ_SHORT();
       frame->ip += offset;
       Chunk chunk = frame->closure->function->chunk;
@@ -109,53 +187,38 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       // return and its payload, which mark the end of the ast.
       OK_IF(astChunk(frame, chunk.code + chunk.count - 1, root));
     }
-    case OP_JUMP_IF_FALSE:
+    CASE(OP_JUMP_IF_FALSE):
       OK_IF(astConditional(frame, root, "opConditional"));
-    case OP_ITER:
+    CASE(OP_ITER):
       OK_IF(astIter(frame, root, "opIter"));
-    case OP_LOOP: {
+    CASE(OP_LOOP): {
       READ_SHORT();
       // here OP_LOOP just concludes a scope.
       return AST_INSTRUCTION_COMPLETE;
     }
-    case OP_GET_GLOBAL: {
+    CASE(OP_GET_GLOBAL): {
       ObjString* name = READ_STRING();
       vmPush(root);
       vmPush(OBJ_VAL(name));
 
       OK_IF(vmExecuteMethod("opGetGlobal", 1));
     }
-    case OP_DEFINE_GLOBAL:
-    case OP_SET_GLOBAL: {
-      ObjString* name = READ_STRING();
-      Value value = vmPeek(0);
-
-      vmPush(root);
-
-      if (!astGlobal(name)) return AST_INSTRUCTION_FAIL;
-      vmPush(value);
-
-      FAIL_UNLESS(vmExecuteMethod("opSetGlobalValue", 2));
-      vmPop();  // nil.
+    CASE(OP_DEFINE_GLOBAL):
+    CASE(OP_SET_GLOBAL):
+      OK_IF(astSetGlobal(root, READ_STRING()));
+    CASE(OP_SET_GLOBAL_POP):
+      FAIL_UNLESS(astSetGlobal(root, READ_STRING()));
+      vmPop();
       return AST_INSTRUCTION_OK;
-    }
-    case OP_GET_LOCAL:
-      OK_IF(astLocal(READ_SHORT(), frame->closure->function));
-    case OP_SET_LOCAL: {
-      uint16_t slot = READ_SHORT();
-      Value value = vmPeek(0);
-
-      vmPush(root);
-
-      if (!astLocal(slot, frame->closure->function))
-        return AST_INSTRUCTION_FAIL;
-      vmPush(value);
-
-      FAIL_UNLESS(vmExecuteMethod("opSetLocalValue", 2));
-      vmPop();  // nil.
+    CASE(OP_GET_LOCAL):
+      OK_IF(astLocal(frame, READ_SHORT()));
+    CASE(OP_SET_LOCAL):
+      OK_IF(astSetLocal(frame, root, READ_SHORT()));
+    CASE(OP_SET_LOCAL_POP):
+      FAIL_UNLESS(astSetLocal(frame, root, READ_SHORT()));
+      vmPop();
       return AST_INSTRUCTION_OK;
-    }
-    case OP_GET_UPVALUE: {
+    CASE(OP_GET_UPVALUE): {
       uint8_t slot = READ_SHORT();
       ObjUpvalue* upvalue = frame->closure->upvalues[slot];
 
@@ -164,16 +227,12 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       OK_IF(vmExecuteMethod("opGetUpvalue", 1));
     }
-    case OP_GET_PROPERTY: {
-      Value key = READ_CONSTANT();
-      Value obj = vmPop();
-
-      vmPush(root);
-      vmPush(obj);
-      vmPush(key);
-      OK_IF(vmExecuteMethod("opGetProperty", 2));
-    }
-    case OP_SET_PROPERTY: {
+    CASE(OP_GET_PROPERTY):
+      OK_IF(astGetProperty(root, READ_CONSTANT()));
+    CASE(OP_GET_LOCAL_PROPERTY):
+      FAIL_UNLESS(astLocal(frame, READ_SHORT()));
+      OK_IF(astGetProperty(root, READ_CONSTANT()));
+    CASE(OP_SET_PROPERTY): {
       Value key = READ_CONSTANT();
 
       Value value = vmPop();
@@ -188,7 +247,7 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPush(object);
       return AST_INSTRUCTION_OK;
     }
-    case OP_SUBSCRIPT_GET: {
+    CASE(OP_SUBSCRIPT_GET): {
       Value key = vmPop();
       Value obj = vmPop();
 
@@ -197,7 +256,7 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPush(key);
       OK_IF(vmExecuteMethod("opSubscriptGet", 2));
     }
-    case OP_SUBSCRIPT_SET: {
+    CASE(OP_SUBSCRIPT_SET): {
       Value value = vmPop();
       Value key = vmPop();
       Value object = vmPop();
@@ -211,7 +270,7 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       return AST_INSTRUCTION_OK;
     }
-    case OP_EQUAL: {
+    CASE(OP_EQUAL): {
       Value left = vmPop();
       Value right = vmPop();
 
@@ -221,17 +280,17 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       OK_IF(vmExecuteMethod("opEqual", 2));
     }
-    case OP_VARIABLE: {
+    CASE(OP_VARIABLE): {
       vmPush(root);
       vmVariable(frame);
       OK_IF(vmExecuteMethod("opVariable", 1));
     }
-    case OP_CLOSE_UPVALUE: {
+    CASE(OP_CLOSE_UPVALUE): {
       vmCloseUpvalues(vm.stackTop - 1);
       vmPop();
       return AST_INSTRUCTION_OK;
     }
-    case OP_SIGN: {
+    CASE(OP_SIGN): {
       vmClosure(frame);
       Value closure = vmPeek(1);
       FAIL_UNLESS(vmExecuteMethod("opSignature", 1));
@@ -241,7 +300,7 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPush(closure);
       return AST_INSTRUCTION_OK;
     }
-    case OP_OVERLOAD: {
+    CASE(OP_OVERLOAD): {
       int i = *frame->ip;
       int count = i;
 
@@ -259,8 +318,8 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
           return AST_INSTRUCTION_FAIL;
         }
         Value rawClosure;
-        if (!mapGet(&AS_INSTANCE(closureAst)->fields,
-                    OBJ_VAL(vm.core.sFunction), &rawClosure)) {
+        if (!instanceGet(AS_INSTANCE(closureAst), OBJ_VAL(vm.core.sFunction),
+                         &rawClosure)) {
           vmRuntimeError("ASTClosure missing its 'function' field.");
           return AST_INSTRUCTION_FAIL;
         }
@@ -282,16 +341,16 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       // finally create the ast overload object.
       OK_IF(astOverload(AS_OVERLOAD(overload)));
     }
-    case OP_CLOSURE:
+    CASE(OP_CLOSURE):
       vmClosure(frame);
       OK_IF(astClosure(&root, AS_CLOSURE(vmPeek(0)), vm.core.astClosure));
-    case OP_COMPREHENSION: {
+    CASE(OP_COMPREHENSION): {
       vmClosure(frame);
 
       Value closure = vmPop();
       Value instance = vmPop();
       vmPush(closure);
-      vmInitFrame(AS_CLOSURE(closure), 0);
+      FAIL_UNLESS(vmInitFrame(AS_CLOSURE(closure), 0));
 
       // an [ASTComprehension] instance has four arguments.
       vmPush(OBJ_VAL(vm.core.astComprehension));
@@ -317,11 +376,11 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       return AST_INSTRUCTION_OK;
     }
-    case OP_COMPREHENSION_PRED:
+    CASE(OP_COMPREHENSION_PRED):
       OK_IF(astConditional(frame, root, "opComprehensionPred"));
-    case OP_COMPREHENSION_ITER:
+    CASE(OP_COMPREHENSION_ITER):
       OK_IF(astIter(frame, root, "opComprehensionIter"));
-    case OP_COMPREHENSION_BODY: {
+    CASE(OP_COMPREHENSION_BODY): {
       Value expr = vmPeek(0);
       vmPush(root);
       vmPush(expr);
@@ -329,7 +388,8 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPop();  // nil.
       return AST_INSTRUCTION_OK;
     }
-    case OP_CALL: {
+    CASE(OP_CALL):
+    CASE(OP_TAIL_CALL): {
       int argCount = READ_BYTE();
       Value args[argCount];
 
@@ -341,7 +401,30 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       OK_IF(vmExecuteMethod("opCall", argCount + 1));
     }
-    case OP_CALL_INFIX: {
+    CASE(OP_INVOKE):
+    CASE(OP_TAIL_INVOKE): {
+      // translated as a property access and a call.
+      Value key = READ_CONSTANT();
+      int argCount = READ_BYTE();
+      Value obj = vmPeek(argCount);
+
+      vmPush(root);
+      vmPush(obj);
+      vmPush(key);
+      FAIL_UNLESS(vmExecuteMethod("opGetProperty", 2));
+
+      Value fn = vmPop();
+      Value args[UINT8_COUNT];
+      for (int i = 0; i < argCount; i++) args[i] = vmPop();
+      vmPop();  // obj.
+
+      vmPush(root);
+      vmPush(fn);
+      for (int i = argCount - 1; i >= 0; i--) vmPush(args[i]);
+
+      OK_IF(vmExecuteMethod("opCall", argCount + 1));
+    }
+    CASE(OP_CALL_INFIX): {
       READ_SHORT();
       Value right = vmPop();
       Value infix = vmPop();
@@ -354,7 +437,34 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       OK_IF(vmExecuteMethod("opCallInfix", 3));
     }
-    case OP_CALL_POSTFIX: {
+    CASE(OP_ADD):
+    CASE(OP_SUB):
+    CASE(OP_MUL):
+    CASE(OP_DIV):
+    CASE(OP_LT):
+    CASE(OP_GT):
+    CASE(OP_LTE):
+    CASE(OP_GTE): {
+      // the operator is an implicit global.
+      ObjString* name = READ_STRING();
+
+      // the operands stay on the stack while the global is built.
+      vmPush(root);
+      vmPush(root);
+      vmPush(OBJ_VAL(name));
+      FAIL_UNLESS(vmExecuteMethod("opGetGlobal", 1));
+
+      Value infix = vmPeek(0);
+      Value right = vmPeek(2);
+      Value left = vmPeek(3);
+      vm.stackTop[-4] = root;
+      vm.stackTop[-3] = infix;
+      vm.stackTop[-2] = left;
+      vm.stackTop[-1] = right;
+
+      OK_IF(vmExecuteMethod("opCallInfix", 3));
+    }
+    CASE(OP_CALL_POSTFIX): {
       int argCount = READ_BYTE();
       Value postfix = vmPop();
       Value args[argCount];
@@ -369,7 +479,7 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       OK_IF(vmExecuteMethod("opCall", argCount + 1));
     }
-    case OP_MEMBER: {
+    CASE(OP_MEMBER): {
       Value obj = vmPop();
       Value val = vmPop();
 
@@ -378,7 +488,7 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPush(obj);
       OK_IF(vmExecuteMethod("opMember", 2));
     }
-    case OP_THROW: {
+    CASE(OP_THROW): {
       Value exc = vmPop();
       vmPush(root);
       vmPush(exc);
@@ -386,26 +496,26 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPop();
       return AST_INSTRUCTION_OK;
     }
-    case OP_IMPORT: {
+    CASE(OP_IMPORT): {
       ObjModule* module = AS_MODULE(READ_CONSTANT());
 
       vmPush(root);
 
       FAIL_UNLESS(vmImportAsInstance(module));
-      frame = &vm.frames[vm.frameCount - 1];
+      frame = vmFrame(vm.frameCount - 1);
 
       if (!vmExecuteMethod("opImport", 1)) return AST_INSTRUCTION_FAIL;
       vmPop();  // nil.
 
       return AST_INSTRUCTION_OK;
     }
-    case OP_IMPORT_AS: {
+    CASE(OP_IMPORT_AS): {
       ObjModule* module = AS_MODULE(READ_CONSTANT());
       Value alias = READ_CONSTANT();
       vmPush(root);
 
       FAIL_UNLESS(vmImportAsInstance(module));
-      frame = &vm.frames[vm.frameCount - 1];
+      frame = vmFrame(vm.frameCount - 1);
 
       vmPush(alias);
 
@@ -413,20 +523,19 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPop();  // nil.
       return AST_INSTRUCTION_OK;
     }
-    case OP_SET_TYPE_LOCAL: {
+    CASE(OP_SET_TYPE_LOCAL): {
       uint8_t slot = READ_SHORT();
       Value type = vmPeek(0);
 
       vmPush(root);
-      if (!astLocal(slot, frame->closure->function))
-        return AST_INSTRUCTION_FAIL;
+      if (!astLocal(frame, slot)) return AST_INSTRUCTION_FAIL;
       vmPush(type);
 
       FAIL_UNLESS(vmExecuteMethod("opSetLocalType", 2));
       vmPop();  // nil.
       return AST_INSTRUCTION_OK;
     }
-    case OP_SET_TYPE_GLOBAL: {
+    CASE(OP_SET_TYPE_GLOBAL): {
       ObjString* name = READ_STRING();
       Value type = vmPeek(0);
 
@@ -438,12 +547,12 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
       vmPop();  // nil.
       return AST_INSTRUCTION_OK;
     }
-    case OP_UNIT: {
+    CASE(OP_UNIT): {
       vmPush(root);
       vmPush(UNIT_VAL);
       OK_IF(vmExecuteMethod("opLiteral", 1));
     }
-    case OP_QUANTIFY: {
+    CASE(OP_QUANTIFY): {
       Value body = vmPop();
       Value restriction = vmPop();
       Value quantifier = vmPop();
@@ -456,13 +565,17 @@ ASTInstructionResult astInstruction(CallFrame* frame, Value root) {
 
       OK_IF(vmInitInstance(vm.core.astQuantification, 3));
     }
-    default: {
-      vmRuntimeError("Unhandled destructured opcode (%i).", instruction);
-      return AST_INSTRUCTION_FAIL;
-    }
+#ifndef COMPUTED_GOTO
+    default:
+      goto L_UNHANDLED;
+#endif
   }
 
+L_UNHANDLED:
+  vmRuntimeError("Unhandled destructured opcode (%i).", instruction);
   return AST_INSTRUCTION_FAIL;
+
+#undef CASE
 }
 
 bool astIter(CallFrame* frame, Value root, char* method) {
@@ -473,7 +586,7 @@ bool astIter(CallFrame* frame, Value root, char* method) {
 
   vmPush(root);
   // local slot.
-  if (!astLocal(local, frame->closure->function)) return false;
+  if (!astLocal(frame, local)) return false;
   // iterator.
   vmPush(iterator);
   // body; translate up to OP_LOOP.
@@ -542,7 +655,7 @@ bool astChunk(CallFrame* frame, uint8_t* ipEnd, Value root) {
 
 // Translate a [CallFrame] into an [ASTNode].
 bool astFrame(Value root) {
-  CallFrame* frame = &vm.frames[vm.frameCount - 1];
+  CallFrame* frame = vmFrame(vm.frameCount - 1);
   for (;;) {
     TRACE_EXECUTION("\n (ast frame) ");
 
@@ -564,11 +677,14 @@ bool astFrame(Value root) {
   return false;
 }
 
-bool astLocal(uint8_t slot, ObjFunction* function) {
-  Token token = function->locals[slot].name;
+// The local in [slot], named for the instruction just read.
+bool astLocal(CallFrame* frame, uint8_t slot) {
+  ObjFunction* function = frame->closure->function;
+  int offset = frame->ip - function->chunk.code - 1;
+
   vmPush(OBJ_VAL(vm.core.astLocal));
   vmPush(NUMBER_VAL(slot));
-  vmPush(OBJ_VAL(copyString(token.start, token.length)));
+  vmPush(OBJ_VAL(localName(function, slot, offset)));
   return vmInitInstance(vm.core.astLocal, 2);
 }
 
@@ -578,6 +694,45 @@ bool astGlobal(ObjString* name) {
   return vmInitInstance(vm.core.astGlobal, 1);
 }
 
+// Assign the value on top of the stack to the local in [slot],
+// leaving the value where it is.
+bool astSetLocal(CallFrame* frame, Value root, uint16_t slot) {
+  Value value = vmPeek(0);
+
+  vmPush(root);
+
+  if (!astLocal(frame, slot)) return false;
+  vmPush(value);
+
+  if (!vmExecuteMethod("opSetLocalValue", 2)) return false;
+  vmPop();  // nil.
+  return true;
+}
+
+// Assign the value on top of the stack to the global [name],
+// leaving the value where it is.
+bool astSetGlobal(Value root, ObjString* name) {
+  Value value = vmPeek(0);
+
+  vmPush(root);
+
+  if (!astGlobal(name)) return false;
+  vmPush(value);
+
+  if (!vmExecuteMethod("opSetGlobalValue", 2)) return false;
+  vmPop();  // nil.
+  return true;
+}
+
+bool astGetProperty(Value root, Value key) {
+  Value obj = vmPop();
+
+  vmPush(root);
+  vmPush(obj);
+  vmPush(key);
+  return vmExecuteMethod("opGetProperty", 2);
+}
+
 bool astUpvalues(ObjClosure* closure, bool root) {
   // if the closure is the root of the ast, any upvalues
   // it closes over are resolvable, so we distinguish them.
@@ -589,7 +744,7 @@ bool astUpvalues(ObjClosure* closure, bool root) {
     vmPush(NUMBER_VAL((uintptr_t)closure->upvalues[i]));
     vmPush(NUMBER_VAL(closure->upvalues[i]->slot));
     vmPush(OBJ_VAL(closure->upvalues[i]));
-    vmPush(OBJ_VAL(closure->upvalues[i]->name));
+    vmPush(OBJ_VAL(upvalueName(closure->upvalues[i])));
 
     if (!vmInitInstance(astClass, 4)) return false;
   }
@@ -597,7 +752,7 @@ bool astUpvalues(ObjClosure* closure, bool root) {
 }
 
 bool astClosure(Value* enclosing, ObjClosure* closure, ObjClass* closureClass) {
-  vmInitFrame(closure, 0);
+  if (!vmInitFrame(closure, 0)) return false;
 
   // the root of the tree is an [ASTClosure] instance that
   // has three arguments.
@@ -675,7 +830,7 @@ bool astOverload(ObjOverload* overload) {
 }
 
 bool ast(Value value) {
-  switch (value.vmType) {
+  switch (VALUE_TYPE(value)) {
     case VAL_OBJ: {
       switch (OBJ_TYPE(value)) {
         case OBJ_BOUND_FUNCTION:
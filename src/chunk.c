@@ -9,14 +9,19 @@ void initChunk(Chunk* chunk) {
   chunk->count = 0;
   chunk->capacity = 0;
   chunk->code = NULL;
+  chunk->lineCount = 0;
+  chunk->lineCapacity = 0;
   chunk->lines = NULL;
   initValueArray(&chunk->constants);
+  chunk->cacheCount = 0;
+  chunk->caches = NULL;
 }
 
 void freeChunk(Chunk* chunk) {
   FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
-  FREE_ARRAY(int, chunk->lines, chunk->capacity);
+  FREE_ARRAY(LineRun, chunk->lines, chunk->lineCapacity);
   freeValueArray(&chunk->constants);
+  FREE_ARRAY(InlineCache, chunk->caches, chunk->cacheCount);
   initChunk(chunk);
 }
 
@@ -28,14 +33,46 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line) {
     chunk->capacity = GROW_CAPACITY(oldCapacity);
     chunk->code =
         GROW_ARRAY(uint8_t, chunk->code, oldCapacity, chunk->capacity);
-    chunk->lines = GROW_ARRAY(int, chunk->lines, oldCapacity, chunk->capacity);
   }
 
+  writeLine(chunk, chunk->count, line);
   chunk->code[chunk->count] = byte;
-  chunk->lines[chunk->count] = line;
   chunk->count++;
 }
 
+// Mark the code from [offset] on as compiled from [line],
+// starting a new run only if the line changed.
+void writeLine(Chunk* chunk, int offset, int line) {
+  if (chunk->lineCount > 0 && chunk->lines[chunk->lineCount - 1].line == line)
+    return;
+
+  if (chunk->lineCapacity < chunk->lineCount + 1) {
+    int oldCapacity = chunk->lineCapacity;
+    chunk->lineCapacity = GROW_CAPACITY(oldCapacity);
+    chunk->lines =
+        GROW_ARRAY(LineRun, chunk->lines, oldCapacity, chunk->lineCapacity);
+  }
+
+  LineRun* run = &chunk->lines[chunk->lineCount++];
+  run->offset = offset;
+  run->line = line;
+}
+
+// The line the byte at [offset] was compiled from.
+int chunkLine(Chunk* chunk, int offset) {
+  // the last run that starts at or before [offset].
+  int low = 0;
+  int high = chunk->lineCount - 1;
+  while (low < high) {
+    int mid = low + (high - low + 1) / 2;
+    if (chunk->lines[mid].offset <= offset)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+  return chunk->lineCount == 0 ? 0 : chunk->lines[low].line;
+}
+
 int addConstant(Chunk* chunk, Value value) {
   vmPush(value);
   writeValueArray(&chunk->constants, value);
@@ -28,7 +28,18 @@ typedef enum {
   OP_ITER,
   OP_LOOP,
   OP_CALL,
+  OP_CALL_SPREAD,
+  OP_INVOKE,
+  OP_INVOKE_SPREAD,
   OP_CALL_INFIX,
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_LT,
+  OP_GT,
+  OP_LTE,
+  OP_GTE,
   OP_CALL_POSTFIX,
   OP_CLOSURE,
   OP_COMPREHENSION,
@@ -57,20 +68,65 @@ typedef enum {
   OP_SET_TYPE_GLOBAL,
   OP_SPREAD,
   OP_UNIT,
-  OP_QUANTIFY
+  OP_QUANTIFY,
+  // superinstructions, formed by the optimizer.
+  OP_POPN,
+  OP_SET_LOCAL_POP,
+  OP_SET_GLOBAL_POP,
+  OP_GET_LOCAL_PROPERTY,
+  OP_TAIL_CALL,
+  OP_TAIL_INVOKE
 } OpCode;
 
+struct ObjClass;
+struct ObjModule;
+
+// Where the name held by a constant was last found,
+// as a global, as an instance field, and as a method.
+typedef struct {
+  // the module executing when the global was found, whose
+  // namespace is searched before the globals, and its size then.
+  struct ObjModule* module;
+  int namespaceCount;
+  // which map held the global, and at what index.
+  bool inNamespace;
+  int globalIndex;
+  // the id of the receiver's shape and the field's slot
+  // in it, or -1 if instances of that shape lack it.
+  uint32_t shapeId;
+  int fieldSlot;
+  // the receiver's class and the method's index in its fields.
+  struct ObjClass* klass;
+  int methodIndex;
+} InlineCache;
+
+// every instruction from [offset] up to the next run's
+// offset was compiled from [line].
+typedef struct {
+  int offset;
+  int line;
+} LineRun;
+
 typedef struct {
   int count;
   int capacity;
   uint8_t* code;
-  int* lines;
+  // one run per change of line, in order of offset.
+  int lineCount;
+  int lineCapacity;
+  LineRun* lines;
   ValueArray constants;
+  // one per constant, allocated the first time the
+  // chunk looks up a global or a method by name.
+  int cacheCount;
+  InlineCache* caches;
 } Chunk;
 
 void initChunk(Chunk* chunk);
 void freeChunk(Chunk* chunk);
 void writeChunk(Chunk* chunk, uint8_t byte, int line);
+void writeLine(Chunk* chunk, int offset, int line);
+int chunkLine(Chunk* chunk, int offset);
 int addConstant(Chunk* chunk, Value value);
 
 #endif
\ No newline at end of file
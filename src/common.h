@@ -28,6 +28,8 @@
 #define S_PUSH "push"
 #define S_POP "pop"
 #define S_HASH "hash"
+#define S_MORE "more"
+#define S_NEXT "next"
 
 #define S_BASE "Base"
 #define S_OBJECT "Object"
@@ -37,6 +39,7 @@
 #define S_MAP "Map"
 #define S_SET "Set"
 #define S_GENERATOR "Generator"
+#define S_ITERATOR "Iterator"
 
 #define S_AST_CLOSURE "ASTClosure"
 #define S_AST_COMPREHENSION "ASTComprehension"
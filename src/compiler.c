@@ -6,6 +6,8 @@
 
 #include "debug.h"
 #include "io.h"
+#include "memory.h"
+#include "optimizer.h"
 #include "vm.h"
 
 #ifdef DEBUG_PRINT_CODE
@@ -265,6 +267,25 @@ static void patchJump(Compiler* cmp, int offset) {
   chunk->code[offset + 1] = jump & 0xff;
 }
 
+// Remember that the slot [slot] holds the local [name] from
+// here on, for reconstructing the function's ast.
+static void recordLocal(Compiler* cmp, Token name, int slot) {
+  ObjFunction* function = cmp->function;
+
+  if (function->localCapacity < function->localCount + 1) {
+    int oldCapacity = function->localCapacity;
+    function->localCapacity = GROW_CAPACITY(oldCapacity);
+    function->locals = GROW_ARRAY(LocalName, function->locals, oldCapacity,
+                                  function->localCapacity);
+  }
+
+  LocalName* local = &function->locals[function->localCount++];
+  local->start = name.start;
+  local->length = name.length;
+  local->slot = slot;
+  local->offset = function->chunk.count;
+}
+
 void initCompiler(Compiler* cmp, Compiler* enclosing, Compiler* signature,
                   FunctionType functionType, ObjModule* module, Token name) {
   cmp->enclosing = NULL;
@@ -276,20 +297,13 @@ void initCompiler(Compiler* cmp, Compiler* enclosing, Compiler* signature,
   cmp->function = NULL;
   cmp->function = newFunction(cmp->module);
   cmp->functionType = functionType;
-  cmp->function->localCount = 0;
+  cmp->localCount = 0;
   cmp->scopeDepth = 0;
 
   vm.compiler = cmp;
   cmp->function->name = copyString(name.start, name.length);
 
-  for (int i = 0; i < UINT8_COUNT; i++) {
-    cmp->function->locals[i].depth = 0;
-    cmp->function->locals[i].isCaptured = false;
-
-    initToken(&cmp->function->locals[i].name);
-  }
-
-  Local* local = &cmp->function->locals[cmp->function->localCount++];
+  Local* local = &cmp->locals[cmp->localCount++];
   local->depth = 0;
   local->isCaptured = false;
   local->name.type = TOKEN_IDENTIFIER;
@@ -300,6 +314,7 @@ void initCompiler(Compiler* cmp, Compiler* enclosing, Compiler* signature,
     local->name.start = "";
     local->name.length = 0;
   }
+  recordLocal(cmp, local->name, 0);
 }
 
 static void emitDefaultReturn(Compiler* cmp) {
@@ -321,8 +336,34 @@ static void emitDefaultReturn(Compiler* cmp) {
 #define DEBUG_CHUNK()
 #endif
 
+// Expose the parts of [function]'s signature that never change
+// as fields, once, rather than each time a closure is made.
+static void defineSignatureFields(ObjFunction* function) {
+  if (function->name != NULL)
+    mapSet(&function->fields, OBJ_VAL(vm.core.sName),
+           OBJ_VAL(function->name));
+  mapSet(&function->fields, OBJ_VAL(vm.core.sArity),
+         NUMBER_VAL(function->arity));
+  mapSet(&function->fields, OBJ_VAL(vm.core.sPatterned),
+         BOOL_VAL(function->patterned));
+  mapSet(&function->fields, OBJ_VAL(vm.core.sVariadic),
+         BOOL_VAL(function->variadic));
+}
+
+// Trim the function's locals table to the locals it declared.
+static void trimLocals(ObjFunction* function) {
+  function->locals = GROW_ARRAY(LocalName, function->locals,
+                                function->localCapacity, function->localCount);
+  function->localCapacity = function->localCount;
+}
+
 static ObjFunction* endCompiler(Compiler* cmp) {
   emitDefaultReturn(cmp);
+  if (!parser.hadError) optimizeChunk(cmp->function);
+  defineSignatureFields(cmp->function);
+  trimLocals(cmp->function);
+  // it was written to without barriers while it was compiled.
+  rememberObject((Obj*)cmp->function);
 
   DEBUG_CHUNK()
 
@@ -335,16 +376,15 @@ static void beginScope(Compiler* cmp) { cmp->scopeDepth++; }
 static void endScope(Compiler* cmp) {
   cmp->scopeDepth--;
 
-  while (cmp->function->localCount > 0 &&
-         cmp->function->locals[cmp->function->localCount - 1].depth >
-             cmp->scopeDepth) {
-    if (cmp->function->locals[cmp->function->localCount - 1].isCaptured) {
+  while (cmp->localCount > 0 &&
+         cmp->locals[cmp->localCount - 1].depth > cmp->scopeDepth) {
+    if (cmp->locals[cmp->localCount - 1].isCaptured) {
       emitByte(cmp, OP_CLOSE_UPVALUE);
     } else {
       emitByte(cmp, OP_POP);
     }
 
-    cmp->function->localCount--;
+    cmp->localCount--;
   }
 }
 
@@ -366,9 +406,13 @@ static void closeFunction(Compiler* cmp, Compiler* enclosing, OpCode op) {
 
 static void signFunction(Compiler* cmp, Compiler* sigCmp, Compiler* enclosing) {
   emitDefaultReturn(cmp);
+  if (!parser.hadError) optimizeChunk(cmp->function);
   ObjFunction* function = cmp->function;
   emitConstInstr(enclosing, OP_CLOSURE,
                  makeConstant(enclosing, OBJ_VAL(function)));
+  defineSignatureFields(function);
+  trimLocals(function);
+  rememberObject((Obj*)function);
 
   closeUpvalues(function, cmp, enclosing);
   closeFunction(sigCmp, enclosing, OP_SIGN);
@@ -406,8 +450,8 @@ static bool identifiersEqual(Token* a, Token* b) {
 }
 
 static int resolveLocal(Compiler* cmp, Token* name) {
-  for (int i = cmp->function->localCount - 1; i >= 0; i--) {
-    Local* local = &cmp->function->locals[i];
+  for (int i = cmp->localCount - 1; i >= 0; i--) {
+    Local* local = &cmp->locals[i];
 
     if (identifiersEqual(name, &local->name)) {
       if (local->depth == -1) {
@@ -445,7 +489,7 @@ static int resolveUpvalue(Compiler* cmp, Token* name) {
 
   int local = resolveLocal(cmp->enclosing, name);
   if (local != -1) {
-    cmp->enclosing->function->locals[local].isCaptured = true;
+    cmp->enclosing->locals[local].isCaptured = true;
     return addUpvalue(cmp, (uint8_t)local, true);
   }
 
@@ -458,29 +502,30 @@ static int resolveUpvalue(Compiler* cmp, Token* name) {
 }
 
 static uint8_t addLocal(Compiler* cmp, Token name) {
-  if (cmp->function->localCount == UINT8_COUNT) {
+  if (cmp->localCount == UINT8_COUNT) {
     error(cmp, "Too many local variables in function.");
     return 0;
   }
 
-  Local* local = &cmp->function->locals[cmp->function->localCount++];
+  Local* local = &cmp->locals[cmp->localCount++];
 
   local->name = name;
   local->depth = -1;
   local->isCaptured = false;
+  recordLocal(cmp, name, cmp->localCount - 1);
 
-  return cmp->function->localCount - 1;
+  return cmp->localCount - 1;
 }
 
 static void markInitialized(Compiler* cmp) {
   if (cmp->scopeDepth == 0) return;
 
-  cmp->function->locals[cmp->function->localCount - 1].depth = cmp->scopeDepth;
+  cmp->locals[cmp->localCount - 1].depth = cmp->scopeDepth;
 }
 
 static uint8_t declareLocal(Compiler* cmp, Token* name) {
-  for (int i = cmp->function->localCount - 1; i >= 0; i--) {
-    Local* local = &cmp->function->locals[i];
+  for (int i = cmp->localCount - 1; i >= 0; i--) {
+    Local* local = &cmp->locals[i];
     if (local->depth != -1 && local->depth < cmp->scopeDepth) {
       break;
     }
@@ -515,13 +560,17 @@ void getProperty(Compiler* cmp, char* name) {
   emitConstInstr(cmp, OP_GET_PROPERTY, var);
 }
 
-static uint8_t argumentList(Compiler* cmp) {
+// Compile a parenthesized list of arguments, noting in
+// [spreads] whether any of them spread a sequence.
+static uint8_t argumentList(Compiler* cmp, bool* spreads) {
   uint8_t argCount = 0;
+  *spreads = false;
   if (!check(TOKEN_RIGHT_PAREN)) {
     do {
       if (match(cmp, TOKEN_DOUBLE_DOT)) {
         expression(cmp);
         emitByte(cmp, OP_SPREAD);
+        *spreads = true;
       } else {
         expression(cmp);
       }
@@ -556,8 +605,9 @@ static void binary(Compiler* cmp, bool canAssign) {
 }
 
 static void call(Compiler* cmp, bool canAssign) {
-  uint8_t argCount = argumentList(cmp);
-  emitBytes(cmp, OP_CALL, argCount);
+  bool spreads;
+  uint8_t argCount = argumentList(cmp, &spreads);
+  emitBytes(cmp, spreads ? OP_CALL_SPREAD : OP_CALL, argCount);
 }
 
 static void property(Compiler* cmp, bool canAssign) {
@@ -567,6 +617,13 @@ static void property(Compiler* cmp, bool canAssign) {
   if (canAssign && match(cmp, TOKEN_EQUAL)) {
     expression(cmp);
     emitConstInstr(cmp, OP_SET_PROPERTY, name);
+  } else if (check(TOKEN_LEFT_PAREN) && !prevWhite()) {
+    // a method call flush against the property.
+    advance(cmp);
+    bool spreads;
+    uint8_t argCount = argumentList(cmp, &spreads);
+    emitConstInstr(cmp, spreads ? OP_INVOKE_SPREAD : OP_INVOKE, name);
+    emitByte(cmp, argCount);
   } else {
     emitConstInstr(cmp, OP_GET_PROPERTY, name);
   }
@@ -783,9 +840,46 @@ static void variable(Compiler* cmp, bool canAssign) {
   namedVariable(cmp, parser.previous, canAssign);
 }
 
+// The dedicated instruction for the native operator [name],
+// or -1 if there isn't one or [name] is bound locally.
+static int nativeOperator(Compiler* cmp, Token* name) {
+  static const struct {
+    const char* lexeme;
+    OpCode op;
+  } operators[] = {
+      {"+", OP_ADD}, {"-", OP_SUB}, {"*", OP_MUL},  {"/", OP_DIV},
+      {"<", OP_LT},  {">", OP_GT},  {"<=", OP_LTE}, {">=", OP_GTE},
+  };
+
+  if (name->length > 2) return -1;
+
+  for (int i = 0; i < (int)(sizeof(operators) / sizeof(operators[0])); i++) {
+    const char* lexeme = operators[i].lexeme;
+
+    if ((int)strlen(lexeme) == name->length &&
+        memcmp(lexeme, name->start, name->length) == 0) {
+      if (resolveLocal(cmp, name) != -1 || resolveUpvalue(cmp, name) != -1)
+        return -1;
+      return operators[i].op;
+    }
+  }
+
+  return -1;
+}
+
 static void infix(Compiler* cmp, bool canAssign) {
   ParseRule* rule = getInfixRule(cmp, parser.previous);
   uint16_t name = identifierConstant(cmp, &parser.previous);
+
+  // native operators skip the global lookup and run inline
+  // unless the vm finds that they've been rebound.
+  int op = nativeOperator(cmp, &parser.previous);
+  if (op != -1 && penultWhite() && prevWhite()) {
+    parsePrecedence(cmp, (Precedence)(rule->rightPrec));
+    emitConstInstr(cmp, op, name);
+    return;
+  }
+
   variable(cmp, canAssign);
 
   if (penultWhite() && prevWhite()) {
@@ -1038,6 +1132,64 @@ static void typeExpression(Compiler* cmp) {
   parsePrecedence(cmp, PREC_TYPE_ASSIGNMENT);
 }
 
+// Record how the next parameter of [function] matches arguments.
+static void addParamMatch(ObjFunction* function, MatchKind kind,
+                          Value operand) {
+  function->params = GROW_ARRAY(ParamMatch, function->params,
+                                function->paramCount, function->paramCount + 1);
+  function->params[function->paramCount].kind = kind;
+  function->params[function->paramCount].operand = operand;
+  function->paramCount++;
+}
+
+static Value constantOperand(Chunk* chunk, int offset) {
+  uint16_t index =
+      (uint16_t)(chunk->code[offset + 1] << 8) | chunk->code[offset + 2];
+  return chunk->constants.values[index];
+}
+
+// If the code from [start] to the end of [chunk] is a single
+// instruction that pushes a constant, put the constant in [value].
+static bool constantPush(Chunk* chunk, int start, Value* value) {
+  if (start >= chunk->count) return false;
+
+  int length = 1;
+  switch (chunk->code[start]) {
+    case OP_CONSTANT:
+      *value = constantOperand(chunk, start);
+      length = 3;
+      break;
+    case OP_NIL:
+      *value = NIL_VAL;
+      break;
+    case OP_TRUE:
+      *value = BOOL_VAL(true);
+      break;
+    case OP_FALSE:
+      *value = BOOL_VAL(false);
+      break;
+    case OP_UNIT:
+      *value = UNIT_VAL;
+      break;
+    case OP_UNDEFINED:
+      *value = UNDEF_VAL;
+      break;
+    default:
+      return false;
+  }
+  return chunk->count == start + length;
+}
+
+// If the code from [start] to the end of [chunk] only reads
+// a global, put the global's name in [name].
+static bool globalPush(Chunk* chunk, int start, Value* name) {
+  if (chunk->count != start + 3 || chunk->code[start] != OP_GET_GLOBAL)
+    return false;
+
+  *name = constantOperand(chunk, start);
+  return true;
+}
+
 static void variableParameter(Compiler* cmp, Compiler* sigCmp) {
   advance(cmp);
   declareVariable(cmp);
@@ -1047,16 +1199,36 @@ static void variableParameter(Compiler* cmp, Compiler* sigCmp) {
   uint16_t constant = identifierConstant(sigCmp, &parser.previous);
   emitConstInstr(sigCmp, OP_VARIABLE, constant);
   // parse an optional type.
-  if (match(sigCmp, TOKEN_COLON))
+  if (match(sigCmp, TOKEN_COLON)) {
+    Chunk* chunk = &sigCmp->function->chunk;
+    int start = chunk->count;
     expression(sigCmp);
-  else
+
+    Value name;
+    if (globalPush(chunk, start, &name))
+      addParamMatch(cmp->function, MATCH_CLASS, name);
+    else
+      addParamMatch(cmp->function, MATCH_TYPE, NIL_VAL);
+  } else {
     emitByte(sigCmp, OP_UNDEFINED);
+    addParamMatch(cmp->function, MATCH_ANY, NIL_VAL);
+  }
 }
 
 static void patternParameter(Compiler* cmp, Compiler* sigCmp) {
+  Chunk* chunk = &sigCmp->function->chunk;
+  int start = chunk->count;
+
   cmp->function->patterned = true;
   // include the literal in the signature.
   parsePrecedence(sigCmp, PREC_ASSIGNMENT);
+
+  Value literal;
+  if (constantPush(chunk, start, &literal))
+    addParamMatch(cmp->function, MATCH_CONSTANT, literal);
+  else
+    addParamMatch(cmp->function, MATCH_LITERAL, NIL_VAL);
+
   // type defaults downstream to a tvar.
   emitByte(sigCmp, OP_UNDEFINED);
   // offset the local stack so that the literal
@@ -2101,8 +2273,14 @@ ObjFunction* compileModule(Compiler* enclosing, const char* source, Token path,
 
 void markCompilerRoots(Compiler* cmp) {
   while (cmp != NULL) {
+    // the functions being compiled are written to without
+    // barriers, so trace them even once they're old.
+    rememberObject((Obj*)cmp->function);
     markObject((Obj*)cmp->function);
-    if (cmp->signature != NULL) markObject((Obj*)cmp->signature->function);
+    if (cmp->signature != NULL) {
+      rememberObject((Obj*)cmp->signature->function);
+      markObject((Obj*)cmp->signature->function);
+    }
     cmp = cmp->enclosing;
   }
 }
\ No newline at end of file
@@ -41,6 +41,8 @@ typedef struct Compiler {
   ObjModule* module;
   FunctionType functionType;
 
+  Local locals[UINT8_COUNT];
+  int localCount;
   Upvalue upvalues[UINT8_COUNT];
   int scopeDepth;
 } Compiler;
@@ -0,0 +1,11 @@
+
+  #ifndef nat_config_h
+  #define nat_config_h
+  #ifdef __EMSCRIPTEN__
+    #define NAT_CORE_LOC "/src/core/index" 
+    #define NAT_SYSTEM_LOC "/src/core/system"
+  #else
+    #define NAT_CORE_LOC "/root/repo/src/core/index" 
+    #define NAT_SYSTEM_LOC "/root/repo/src/core/system"
+  #endif
+  #endif
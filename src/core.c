@@ -8,6 +8,7 @@
 #include "compiler.h"
 #include "debug.h"
 #include "io.h"
+#include "memory.h"
 
 static void defineNativeFn(char* name, int arity, bool variadic,
                            NativeFn function, ObjMap* dest) {
@@ -30,6 +31,11 @@ static void defineNativeFnGlobal(char* name, int arity, NativeFn function) {
 static void defineNativeFnMethod(char* name, int arity, bool variadic,
                                  NativeFn function, ObjClass* klass) {
   defineNativeFn(name, arity, variadic, function, &klass->fields);
+
+  Value fn;
+  Value fnName = INTERN(name);
+  mapGet(&klass->fields, fnName, &fn);
+  vmClassSet(klass, fnName, fn);
 }
 
 static void defineNativeAffixGlobal(char* name, int arity, NativeFn function,
@@ -67,7 +73,7 @@ static void defineInstanceProperty(char* name, ObjInstance* instance,
   ObjString* objName = intern(name);
   vmPush(OBJ_VAL(objName));
   vmPush(property);
-  mapSet(&instance->fields, vmPeek(1), vmPeek(0));
+  instanceSet(instance, vmPeek(1), vmPeek(0));
   vmPop();
   vmPop();
 }
@@ -85,7 +91,7 @@ bool getGlobalObj(char* name, Value* obj, ObjType type) {
 
   if (OBJ_TYPE(*obj) != type) {
     vmRuntimeError("Global has wrong type. Expected '%i' but got '%i.", type,
-                   obj->vmType);
+                   OBJ_TYPE(*obj));
     return false;
   }
 
@@ -115,34 +121,38 @@ ObjSequence* __sequentialInit__(int argCount) {
 
   ObjSequence* seq = newSequence();
   vmPush(OBJ_VAL(seq));
-  mapSet(&obj->fields, OBJ_VAL(vm.core.sValues), vmPeek(0));
+  instanceSet(obj, OBJ_VAL(vm.core.sValues), vmPeek(0));
   vmPop();
 
   int i = argCount;
-  while (i-- > 0) writeValueArray(&seq->values, vmPeek(i));
+  while (i-- > 0) {
+    writeValueArray(&seq->values, vmPeek(i));
+    writeBarrier((Obj*)seq, vmPeek(i));
+  }
   while (++i < argCount) vmPop();
 
   return seq;
 }
 
-bool __sequenceInit__(int argCount, Value* args) {
+bool __sequenceInit__(int argCount) {
   __sequentialInit__(argCount);
 
   return true;
 }
 
-bool __sequencePush__(int argCount, Value* args) {
+bool __sequencePush__(int argCount) {
   Value val = vmPeek(0);
   ObjInstance* obj = AS_INSTANCE(vmPeek(1));
   Value seq;
 
   if (!vmSequenceValueField(obj, &seq)) return false;
   writeValueArray(&AS_SEQUENCE(seq)->values, val);
+  writeBarrier(AS_OBJ(seq), val);
   vmPop();
   return true;
 }
 
-bool __sequencePop__(int argCount, Value* args) {
+bool __sequencePop__(int argCount) {
   ObjInstance* obj = AS_INSTANCE(vmPeek(0));
   Value seq;
   if (!vmSequenceValueField(obj, &seq)) return false;
@@ -157,27 +167,42 @@ bool __sequencePop__(int argCount, Value* args) {
   return true;
 }
 
-bool __tupleInit__(int argCount, Value* args) {
+bool __tupleInit__(int argCount) {
   __sequentialInit__(argCount);
 
   return true;
 }
 
-bool __objKeys__(int argCount, Value* args) {
+// Push the names of [obj]'s fields in [shape] onto the
+// key sequence on top of the stack, in slot order.
+static bool pushShapeKeys(ObjInstance* obj, Shape* shape) {
+  if (shape->parent == NULL) return true;
+  if (!pushShapeKeys(obj, shape->parent)) return false;
+  if (IS_UNDEF(obj->slots[shape->slot])) return true;
+
+  vmPush(OBJ_VAL(shape->name));
+  return vmInvoke(intern("push"), 1);
+}
+
+bool __objKeys__(int argCount) {
   ObjInstance* obj = AS_INSTANCE(vmPeek(0));
 
   // the key sequence.
   vmPush(OBJ_VAL(vm.core.sequence));
   if (!vmCallValue(vmPeek(0), 0)) return false;
 
-  for (int i = 0; i < obj->fields.capacity; i++) {
-    MapEntry* entry = &obj->fields.entries[i];
-    if (IS_UNDEF(entry->key) || IS_UNDEF(entry->value)) continue;
-
-    // add to sequence. seq's 'push' method
-    // leaves itself on the stack for us.
-    vmPush(entry->key);
-    if (!vmInvoke(intern("push"), 1)) return false;
+  if (obj->shape != NULL) {
+    if (!pushShapeKeys(obj, obj->shape)) return false;
+  } else {
+    for (int i = 0; i < obj->fields.capacity; i++) {
+      MapEntry* entry = &obj->fields.entries[i];
+      if (IS_UNDEF(entry->key) || IS_UNDEF(entry->value)) continue;
+
+      // add to sequence. seq's 'push' method
+      // leaves itself on the stack for us.
+      vmPush(entry->key);
+      if (!vmInvoke(intern("push"), 1)) return false;
+    }
   }
 
   Value keys = vmPop();
@@ -187,7 +212,7 @@ bool __objKeys__(int argCount, Value* args) {
   return true;
 }
 
-bool __randomNumber__(int argCount, Value* args) {
+bool __randomNumber__(int argCount) {
   Value upperBound = vmPop();
   vmPop();  // native fn.
 
@@ -201,7 +226,7 @@ bool __randomNumber__(int argCount, Value* args) {
   return true;
 }
 
-bool __length__(int argCount, Value* args) {
+bool __length__(int argCount) {
   Value obj = vmPop();
   vmPop();  // native fn.
 
@@ -218,14 +243,14 @@ bool __length__(int argCount, Value* args) {
     }
     case OBJ_INSTANCE: {
       ObjInstance* instance = AS_INSTANCE(obj);
-      Value method;
-      if (mapGet(&instance->klass->fields, INTERN(S_LEN), &method)) {
+      Value method = instance->klass->protocol[PROTOCOL_LEN];
+      if (!IS_UNDEF(method)) {
         vmPush(OBJ_VAL(instance));  // receiver.
         return vmCallValue(method, 0);
       }
 
       // otherwise default to the instance's field count.
-      vmPush(NUMBER_VAL(instance->fields.count));
+      vmPush(NUMBER_VAL(instanceCount(instance)));
       return true;
     }
     case OBJ_STRING: {
@@ -241,7 +266,7 @@ bool __length__(int argCount, Value* args) {
   }
 }
 
-bool __hash__(int argCount, Value* args) {
+bool __hash__(int argCount) {
   Value value = vmPop();
   vmPop();  // native fn.
 
@@ -251,18 +276,59 @@ bool __hash__(int argCount, Value* args) {
   return true;
 }
 
-bool __vmHashable__(int argCount, Value* args) {
+bool __vmHashable__(int argCount) {
   Value value = vmPop();
   vmPop();  // native fn.
   vmPush(BOOL_VAL(vHashable(value)));
   return true;
 }
 
-bool __vmType__(int argCount, Value* args) {
+bool __isSubclass__(int argCount) {
+  Value b = vmPop();
+  Value a = vmPop();
+  vmPop();  // native fn.
+  vmPush(BOOL_VAL(IS_CLASS(a) && IS_CLASS(b) &&
+                  isSubclass(AS_CLASS(a), AS_CLASS(b))));
+  return true;
+}
+
+// Is [a] an instance of [b]?
+bool __is__(int argCount) {
+  Value b = vmPop();
+  Value a = vmPop();
+  vmPop();  // native fn.
+  vmPush(BOOL_VAL(IS_INSTANCE(a) && IS_CLASS(b) &&
+                  isSubclass(AS_INSTANCE(a)->klass, AS_CLASS(b))));
+  return true;
+}
+
+bool __lca__(int argCount) {
+  Value b = vmPop();
+  Value a = vmPop();
+  vmPop();  // native fn.
+
+  ObjClass* lca = NULL;
+  if (IS_CLASS(a) && IS_CLASS(b))
+    lca = leastCommonAncestor(AS_CLASS(a), AS_CLASS(b));
+  vmPush(lca == NULL ? NIL_VAL : OBJ_VAL(lca));
+  return true;
+}
+
+// Literals may now have types beyond their vm types, so
+// flush the dispatch caches and key them on values instead.
+bool __vmDispatchByValue__(int argCount) {
+  vmPop();  // native fn.
+  vm.dispatchByValue = true;
+  vm.dispatchEpoch++;
+  vmPush(NIL_VAL);
+  return true;
+}
+
+bool __vmType__(int argCount) {
   Value value = vmPop();
   vmPop();  // native fn.
 
-  switch (value.vmType) {
+  switch (VALUE_TYPE(value)) {
     case VAL_UNIT:
       vmPush(value);
       break;
@@ -325,7 +391,7 @@ bool __vmType__(int argCount, Value* args) {
   return true;
 }
 
-bool __compile__(int argCount, Value* args) {
+bool __compile__(int argCount) {
   Value source = vmPeek(0), baseName = vmPeek(1), dirName = vmPeek(2);
 
   if (!IS_STRING(baseName)) {
@@ -357,6 +423,7 @@ bool __compile__(int argCount, Value* args) {
   }
 
   module->closure = closure;
+  writeBarrier((Obj*)module, OBJ_VAL(closure));
 
   vmPush(OBJ_VAL(vm.core.module));
   if (!vmInitInstance(vm.core.module, 0)) {
@@ -366,12 +433,12 @@ bool __compile__(int argCount, Value* args) {
 
   ObjInstance* objModule = AS_INSTANCE(vmPeek(0));
 
-  if (!vmImport(module, &objModule->fields)) {
+  if (!vmImport(module, instanceFields(objModule))) {
     vmRuntimeError("Failed to import.");
     return false;
   }
 
-  mapSet(&objModule->fields, OBJ_VAL(vm.core.sModule), OBJ_VAL(module));
+  instanceSet(objModule, OBJ_VAL(vm.core.sModule), OBJ_VAL(module));
 
   vmPop();  // objModule.
   vmPop();  // module.
@@ -383,11 +450,11 @@ bool __compile__(int argCount, Value* args) {
   return true;
 }
 
-bool __moduleImport__(int argCount, Value* args) {
+bool __moduleImport__(int argCount) {
   ObjInstance* obj = AS_INSTANCE(vmPeek(0));
 
   Value module;
-  if (!mapGet(&obj->fields, OBJ_VAL(vm.core.sModule), &module)) {
+  if (!instanceGet(obj, OBJ_VAL(vm.core.sModule), &module)) {
     vmRuntimeError("Module instance missing its module field!");
     return false;
   }
@@ -405,24 +472,25 @@ bool __moduleImport__(int argCount, Value* args) {
   return true;
 }
 
-bool __globals__(int argCount, Value* args) {
+bool __globals__(int argCount) {
   vmPop();  // native fn.
 
   vmPush(OBJ_VAL(vm.core.map));
   vmInitInstance(vm.core.map, 0);
-  mapAddAll(&vm.globals, &AS_INSTANCE(vmPeek(0))->fields);
-  mapAddAll(&vm.module->namespace, &AS_INSTANCE(vmPeek(0))->fields);
+  ObjMap* fields = instanceFields(AS_INSTANCE(vmPeek(0)));
+  mapAddAll(&vm.globals, fields);
+  mapAddAll(&vm.module->namespace, fields);
 
   return true;
 }
 
-bool __clock__(int argCount, Value* args) {
+bool __clock__(int argCount) {
   vmPop();  // native fn.
   vmPush(NUMBER_VAL((double)clock() / CLOCKS_PER_SEC));
   return true;
 }
 
-bool __address__(int argCount, Value* args) {
+bool __address__(int argCount) {
   Value value = vmPop();
   vmPop();  // native fn.
   if (!IS_OBJ(value)) {
@@ -436,7 +504,7 @@ bool __address__(int argCount, Value* args) {
   return true;
 }
 
-bool __ord__(int argCount, Value* args) {
+bool __ord__(int argCount) {
   Value value = vmPop();
   if (!IS_STRING(value) || AS_STRING(value)->length != 1) {
     vmRuntimeError("Expecting string of length 1.");
@@ -448,11 +516,11 @@ bool __ord__(int argCount, Value* args) {
   return true;
 }
 
-bool __str__(int argCount, Value* args) {
+bool __str__(int argCount) {
   Value value = vmPeek(0);
   ObjString* string;
 
-  switch (value.vmType) {
+  switch (VALUE_TYPE(value)) {
     case VAL_UNIT: {
       string = copyString("()", 2);
       break;
@@ -518,7 +586,7 @@ bool __str__(int argCount, Value* args) {
 }
 
 #define BINARY_NATIVE(name, valueType, op)                  \
-  static bool __##name(int argCount, Value* args) {         \
+  static bool __##name(int argCount) {                    \
     do {                                                    \
       if (!IS_NUMBER(vmPeek(0)) || !IS_NUMBER(vmPeek(1))) { \
         vmRuntimeError("Operands must be numbers.");        \
@@ -541,7 +609,7 @@ BINARY_NATIVE(sub__, NUMBER_VAL, -);
 BINARY_NATIVE(div__, NUMBER_VAL, /);
 BINARY_NATIVE(mul__, NUMBER_VAL, *);
 
-bool __print__(int argCount, Value* args) {
+bool __print__(int argCount) {
   printValue(vmPop());
   vmPop();  // fn.
   printf("\n");
@@ -549,7 +617,7 @@ bool __print__(int argCount, Value* args) {
   return true;
 }
 
-bool __add__(int argCount, Value* args) {
+bool __add__(int argCount) {
   if (IS_STRING(vmPeek(0)) && IS_STRING(vmPeek(1))) {
     // can't pop them until after the concatenation,
     // which allocates memory for the new string.
@@ -573,7 +641,7 @@ bool __add__(int argCount, Value* args) {
   return true;
 }
 
-bool __resolveUpvalue__(int argCount, Value* args) {
+bool __resolveUpvalue__(int argCount) {
   Value value = vmPop();
 
   if (!IS_UPVALUE(value)) {
@@ -586,27 +654,32 @@ bool __resolveUpvalue__(int argCount, Value* args) {
   return true;
 }
 
-bool __stackTrace__(int argCount, Value* args) {
+bool __stackTrace__(int argCount) {
   vmPop();
   disassembleStack();
   printf("\n");
   return true;
 }
 
-bool __annotations__(int argCount, Value* args) {
-  Value value = vmPop();
-  vmPop();  // fn.
+bool __annotations__(int argCount) {
+  Value value = vmPeek(0);
 
   if (!IS_OBJ(value)) {
     vmRuntimeError("Only objects have annotations.");
     return false;
   }
 
-  Obj* obj = AS_OBJ(value);
-  for (int i = 0; i < obj->annotations.count; i++)
-    vmPush(obj->annotations.values[i]);
-  vmTuplify(obj->annotations.count, true);
+  // there may be more annotations than room on the stack.
+  ValueArray* annotations = objectAnnotations(AS_OBJ(value));
+  if (annotations == NULL)
+    vmPushSequence(NULL, 0);
+  else
+    vmPushSequence(annotations->values, annotations->count);
 
+  Value sequence = vmPop();
+  vmPop();  // value.
+  vmPop();  // fn.
+  vmPush(sequence);
   return true;
 }
 
@@ -619,6 +692,9 @@ InterpretResult loadCore() {
   defineNativeFnGlobal("hash", 1, __hash__);
   defineNativeFnGlobal("vmHashable", 1, __vmHashable__);
   defineNativeFnGlobal("vmType", 1, __vmType__);
+  defineNativeFnGlobal("vmDispatchByValue", 0, __vmDispatchByValue__);
+  defineNativeFnGlobal("isSubclass", 2, __isSubclass__);
+  defineNativeFnGlobal("lca", 2, __lca__);
   defineNativeFnGlobal("globals", 0, __globals__);
   defineNativeFnGlobal("clock", 0, __clock__);
   defineNativeFnGlobal("random", 1, __randomNumber__);
@@ -636,6 +712,7 @@ InterpretResult loadCore() {
   defineNativeInfixGlobal("-", __sub__, PREC_TERM);
   defineNativeInfixGlobal("/", __div__, PREC_FACTOR);
   defineNativeInfixGlobal("*", __mul__, PREC_FACTOR);
+  defineNativeInfixGlobal("is", __is__, PREC_AND);
 
   defineNativePrefixGlobal("__print__", __print__);
 
@@ -661,6 +738,7 @@ InterpretResult loadCore() {
   defineNativeFnMethod(S_POP, 0, false, __sequencePop__, vm.core.sequence);
 
   if ((vm.core.generator = getGlobalClass(S_GENERATOR)) == NULL) return false;
+  if ((vm.core.iterator = getGlobalClass(S_ITERATOR)) == NULL) return false;
 
   if ((vm.core.module = getGlobalClass(S_MODULE)) == NULL) return false;
   defineNativeFnMethod("__import__", 0, false, __moduleImport__,
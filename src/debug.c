@@ -64,6 +64,16 @@ static int constantInstruction(const char* name, Chunk* chunk, int offset) {
   return offset + 3;
 }
 
+static int invokeInstruction(const char* name, Chunk* chunk, int offset) {
+  uint16_t constant = readShort(chunk, offset);
+  uint8_t argCount = chunk->code[offset + 3];
+
+  printf("%-16s (%d args) %4d '", name, argCount, constant);
+  printValue(chunk->constants.values[constant]);
+  printf("'\n");
+  return offset + 4;
+}
+
 static int closureInstruction(const char* name, Chunk* chunk, int offset) {
   uint16_t constant = readShort(chunk, offset);
   offset += 3;
@@ -87,10 +97,11 @@ static int closureInstruction(const char* name, Chunk* chunk, int offset) {
 int disassembleInstruction(Chunk* chunk, int offset) {
   printf("%04d ", offset);
 
-  if (offset > 0 && chunk->lines[offset] == chunk->lines[offset - 1]) {
+  int line = chunkLine(chunk, offset);
+  if (offset > 0 && line == chunkLine(chunk, offset - 1)) {
     printf("   | ");
   } else {
-    printf("%4d ", chunk->lines[offset]);
+    printf("%4d ", line);
   }
 
   uint8_t instruction = chunk->code[offset];
@@ -141,8 +152,34 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return jumpInstruction("OP_LOOP", -1, chunk, offset);
     case OP_CALL:
       return byteInstruction("OP_CALL", chunk, offset);
+    case OP_CALL_SPREAD:
+      return byteInstruction("OP_CALL_SPREAD", chunk, offset);
+    case OP_INVOKE:
+      return invokeInstruction("OP_INVOKE", chunk, offset);
+    case OP_INVOKE_SPREAD:
+      return invokeInstruction("OP_INVOKE_SPREAD", chunk, offset);
+    case OP_TAIL_CALL:
+      return byteInstruction("OP_TAIL_CALL", chunk, offset);
+    case OP_TAIL_INVOKE:
+      return invokeInstruction("OP_TAIL_INVOKE", chunk, offset);
     case OP_CALL_INFIX:
       return constantInstruction("OP_CALL_INFIX", chunk, offset);
+    case OP_ADD:
+      return constantInstruction("OP_ADD", chunk, offset);
+    case OP_SUB:
+      return constantInstruction("OP_SUB", chunk, offset);
+    case OP_MUL:
+      return constantInstruction("OP_MUL", chunk, offset);
+    case OP_DIV:
+      return constantInstruction("OP_DIV", chunk, offset);
+    case OP_LT:
+      return constantInstruction("OP_LT", chunk, offset);
+    case OP_GT:
+      return constantInstruction("OP_GT", chunk, offset);
+    case OP_LTE:
+      return constantInstruction("OP_LTE", chunk, offset);
+    case OP_GTE:
+      return constantInstruction("OP_GTE", chunk, offset);
     case OP_CALL_POSTFIX:
       return byteInstruction("OP_CALL_POSTFIX", chunk, offset);
     case OP_SIGN:
@@ -236,6 +273,20 @@ int disassembleInstruction(Chunk* chunk, int offset) {
       return simpleInstruction("OP_SPREAD", offset);
     case OP_QUANTIFY:
       return simpleInstruction("OP_QUANTIFY", offset);
+    case OP_POPN:
+      return byteInstruction("OP_POPN", chunk, offset);
+    case OP_SET_LOCAL_POP:
+      return shortInstruction("OP_SET_LOCAL_POP", chunk, offset);
+    case OP_SET_GLOBAL_POP:
+      return constantInstruction("OP_SET_GLOBAL_POP", chunk, offset);
+    case OP_GET_LOCAL_PROPERTY: {
+      uint16_t slot = readShort(chunk, offset);
+      uint16_t constant = readShort(chunk, offset + 2);
+      printf("%-16s %4d %4d '", "OP_GET_LOCAL_PROPERTY", slot, constant);
+      printValue(chunk->constants.values[constant]);
+      printf("'\n");
+      return offset + 5;
+    }
     default:
       printf("Unknown opcode %d\n", instruction);
       return offset + 1;
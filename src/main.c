@@ -6,6 +6,8 @@
 #include "common.h"
 #include "debug.h"
 #include "io.h"
+#include "memory.h"
+#include "optimizer.h"
 #include "vm.h"
 
 static void repl() {
@@ -22,12 +24,38 @@ static void repl() {
   }
 }
 
+static struct option options[] = {
+    // report what the optimizer did with the compiled chunks.
+    {"stats", no_argument, NULL, 's'},
+    // the deepest the call stack may grow.
+    {"max-frames", required_argument, NULL, 'f'},
+    {NULL, 0, NULL, 0},
+};
+
 int main(int argc, char* argv[]) {
   int exitStatus = 0;
+  bool stats = false;
+  int framesMax = FRAMES_MAX;
+
+  int option;
+  while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (option) {
+      case 's':
+        stats = true;
+        break;
+      case 'f':
+        framesMax = atoi(optarg);
+        if (framesMax <= 0) exit(64);
+        break;
+      default:
+        exit(64);
+    }
+  }
 
   if (!initVM()) exit(2);
+  vm.framesMax = framesMax;
 
-  if (argc == 1) {
+  if (optind == argc) {
     repl();
   } else {
     InterpretResult status = vmInterpretEntrypoint((char*)argv[optind]);
@@ -35,6 +63,11 @@ int main(int argc, char* argv[]) {
     if (status == INTERPRET_COMPILE_ERROR) exitStatus = 65;
     if (status == INTERPRET_RUNTIME_ERROR) exitStatus = 70;
 
+    if (stats) {
+      printOptimizerStats();
+      printGarbageStats();
+    }
+
     freeVM();
     return exitStatus;
   }
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "compiler.h"
 #include "vm.h"
@@ -14,18 +15,38 @@
 
 #define GC_HEAP_GROW_FACTOR 2
 
+#ifdef DEBUG_STRESS_GC
+// under stress, every allocation collects the nursery and every
+// [STRESS_MAJOR_INTERVAL]th one collects the whole heap.
+#define STRESS_MAJOR_INTERVAL 64
+static int stressAllocations = 0;
+#endif
+
+// collections and the time spent in them, for --stats.
+static int minorCollections = 0;
+static int majorCollections = 0;
+static clock_t minorTime = 0;
+static clock_t majorTime = 0;
+
 static void markArray(ValueArray* array);
+static void collectYoung();
 
 void* reallocate(void* pointer, size_t oldSize, size_t newSize) {
   vm.bytesAllocated += newSize - oldSize;
 
   if (newSize > oldSize) {
 #ifdef DEBUG_STRESS_GC
-    collectGarbage();
+    if (++stressAllocations % STRESS_MAJOR_INTERVAL == 0) {
+      collectGarbage();
+    } else {
+      collectYoung();
+    }
 #endif
 
     if (vm.bytesAllocated > vm.nextGC) {
       collectGarbage();
+    } else if (vm.bytesAllocated > vm.nextYoungGC) {
+      collectYoung();
     }
   }
 
@@ -67,12 +88,38 @@ void markValue(Value value) {
   if (IS_OBJ(value)) markObject(AS_OBJ(value));
 }
 
+// Add an old [object] to the remembered set, so the next minor
+// collection traces it. Maps embedded in an object are remembered
+// on their own, by their header.
+void rememberObject(Obj* object) {
+  if (!object->isMarked || (object->flags & OBJ_REMEMBERED)) return;
+  object->flags |= OBJ_REMEMBERED;
+
+  if (vm.rememberedCapacity < vm.rememberedCount + 1) {
+    vm.rememberedCapacity = GROW_CAPACITY(vm.rememberedCapacity);
+    vm.remembered =
+        (Obj**)realloc(vm.remembered, sizeof(Obj*) * vm.rememberedCapacity);
+
+    if (vm.remembered == NULL) exit(1);
+  }
+
+  vm.remembered[vm.rememberedCount++] = object;
+}
+
 static void markArray(ValueArray* array) {
   for (int i = 0; i < array->count; i++) {
     markValue(array->values[i]);
   }
 }
 
+static void markDispatch(Dispatch* dispatch) {
+  if (dispatch == NULL) return;
+  for (int i = 0; i < dispatch->count; i++) {
+    DispatchKey* key = &dispatch->entries[i].key;
+    for (int j = 0; j < key->argCount; j++) markValue(key->types[j]);
+  }
+}
+
 static void blackenObject(Obj* object) {
 #ifdef DEBUG_LOG_GC
   printf("%p blacken ", (void*)object);
@@ -80,7 +127,8 @@ static void blackenObject(Obj* object) {
   printf("\n");
 #endif
 
-  markArray(&object->annotations);
+  // an object's annotations live as long as it does.
+  if (object->flags & OBJ_ANNOTATED) markArray(objectAnnotations(object));
 
   switch (object->oType) {
     case OBJ_BOUND_FUNCTION: {
@@ -102,6 +150,7 @@ static void blackenObject(Obj* object) {
       markObject((Obj*)klass->name);
       markObject((Obj*)klass->super);
       markMap(&klass->fields);
+      markShape(klass->shape);
       break;
     }
     case OBJ_CLOSURE: {
@@ -109,6 +158,7 @@ static void blackenObject(Obj* object) {
       markObject((Obj*)closure->function);
       for (int i = 0; i < closure->upvalueCount; i++)
         markObject((Obj*)closure->upvalues[i]);
+      markDispatch(closure->dispatch);
       break;
     }
     case OBJ_OVERLOAD: {
@@ -116,18 +166,22 @@ static void blackenObject(Obj* object) {
       for (int i = 0; i < overload->cases; i++)
         markObject((Obj*)overload->closures[i]);
       markMap(&overload->fields);
+      markDispatch(overload->dispatch);
       break;
     }
     case OBJ_INSTANCE: {
       ObjInstance* instance = (ObjInstance*)object;
       markObject((Obj*)instance->klass);
+      if (instance->shape != NULL)
+        for (int i = 0; i < instance->shape->count; i++)
+          markValue(instance->slots[i]);
       markMap(&instance->fields);
       break;
     }
     case OBJ_UPVALUE: {
       ObjUpvalue* upvalue = (ObjUpvalue*)(object);
       markValue(upvalue->closed);
-      markObject((Obj*)upvalue->name);
+      markObject((Obj*)upvalue->function);
       break;
     }
     case OBJ_FUNCTION: {
@@ -135,6 +189,8 @@ static void blackenObject(Obj* object) {
       markObject((Obj*)function->name);
       markMap(&function->fields);
       markArray(&function->chunk.constants);
+      for (int i = 0; i < function->paramCount; i++)
+        markValue(function->params[i].operand);
       markObject((Obj*)function->module);
       break;
     }
@@ -181,8 +237,6 @@ static void freeObject(Obj* object) {
   printf("%p free type %d\n", (void*)object, object->type);
 #endif
 
-  freeValueArray(&object->annotations);
-
   switch (object->oType) {
     case OBJ_BOUND_FUNCTION:
       FREE(ObjBoundFunction, object);
@@ -190,13 +244,16 @@ static void freeObject(Obj* object) {
     case OBJ_CLASS: {
       ObjClass* klass = (ObjClass*)object;
       klass->super = NULL;
+      FREE_ARRAY(ObjClass*, klass->ancestors, klass->depth + 1);
       freeMap(&klass->fields);
+      freeShape(klass->shape);
       FREE(ObjClass, object);
       break;
     }
     case OBJ_CLOSURE: {
       ObjClosure* closure = (ObjClosure*)object;
       FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
+      if (closure->dispatch != NULL) FREE(Dispatch, closure->dispatch);
       FREE(ObjClosure, object);
       break;
     }
@@ -205,11 +262,14 @@ static void freeObject(Obj* object) {
       freeChunk(&function->chunk);
       freeMap(&function->fields);
       freeMap(&function->constants);
+      FREE_ARRAY(ParamMatch, function->params, function->paramCount);
+      FREE_ARRAY(LocalName, function->locals, function->localCapacity);
       FREE(ObjFunction, object);
       break;
     }
     case OBJ_INSTANCE: {
       ObjInstance* instance = (ObjInstance*)object;
+      FREE_ARRAY(Value, instance->slots, instance->slotCapacity);
       freeMap(&instance->fields);
       FREE(ObjInstance, object);
       break;
@@ -218,6 +278,7 @@ static void freeObject(Obj* object) {
       ObjOverload* overload = (ObjOverload*)object;
       freeMap(&overload->fields);
       FREE_ARRAY(ObjOverload*, overload->closures, overload->cases);
+      if (overload->dispatch != NULL) FREE(Dispatch, overload->dispatch);
       FREE(ObjOverload, object);
       break;
     }
@@ -266,7 +327,9 @@ static void markRoots() {
     markValue(*slot);
   }
   for (int i = 0; i < vm.frameCount; i++) {
-    markObject((Obj*)vm.frames[i].closure);
+    CallFrame* frame = vmFrame(i);
+    markObject((Obj*)frame->closure);
+    markObject((Obj*)frame->enclosing);
   }
   for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL;
        upvalue = upvalue->next) {
@@ -288,11 +351,17 @@ static void markRoots() {
   markObject((Obj*)vm.core.sPatterned);
   markObject((Obj*)vm.core.sVariadic);
   markObject((Obj*)vm.core.sValues);
+  markObject((Obj*)vm.core.sSeq);
+  markObject((Obj*)vm.core.sIdx);
+  markObject((Obj*)vm.core.sEnd);
   markObject((Obj*)vm.core.sSignature);
   markObject((Obj*)vm.core.sFunction);
   markObject((Obj*)vm.core.sModule);
   markObject((Obj*)vm.core.sQuote);
   markObject((Obj*)vm.core.sBackslash);
+  markObject((Obj*)vm.core.sInner);
+  for (int i = 0; i < PROTOCOL_COUNT; i++)
+    markObject((Obj*)vm.core.protocols[i]);
 
   markObject((Obj*)vm.core.sMain);
   markObject((Obj*)vm.core.sExecMain);
@@ -300,6 +369,16 @@ static void markRoots() {
 
   markObject((Obj*)vm.gen);
 
+  for (int i = 0; i < INSTANTIATIONS; i++) {
+    Instantiation* entry = &vm.instantiations[i];
+    if (IS_NIL(entry->callee)) continue;
+
+    markValue(entry->callee);
+    markValue(entry->type);
+    for (int j = 0; j < entry->key.argCount; j++)
+      markValue(entry->key.types[j]);
+  }
+
   markCompilerRoots(vm.compiler);
 }
 
@@ -310,12 +389,51 @@ static void traceReferences() {
   }
 }
 
-static void sweep() {
+static void traceRemembered() {
+  for (int i = 0; i < vm.rememberedCount; i++)
+    blackenObject(vm.remembered[i]);
+}
+
+static void forgetRemembered() {
+  for (int i = 0; i < vm.rememberedCount; i++)
+    vm.remembered[i]->flags &= ~OBJ_REMEMBERED;
+  vm.rememberedCount = 0;
+}
+
+// Mark the maps embedded in [object] as old along with it, so
+// mapSet knows to remember them.
+static void promoteMaps(Obj* object) {
+  switch (object->oType) {
+    case OBJ_CLASS:
+      ((ObjClass*)object)->fields.obj.isMarked = true;
+      break;
+    case OBJ_FUNCTION:
+      ((ObjFunction*)object)->fields.obj.isMarked = true;
+      ((ObjFunction*)object)->constants.obj.isMarked = true;
+      break;
+    case OBJ_INSTANCE:
+      ((ObjInstance*)object)->fields.obj.isMarked = true;
+      break;
+    case OBJ_MODULE:
+      ((ObjModule*)object)->namespace.obj.isMarked = true;
+      break;
+    case OBJ_NATIVE:
+      ((ObjNative*)object)->fields.obj.isMarked = true;
+      break;
+    case OBJ_OVERLOAD:
+      ((ObjOverload*)object)->fields.obj.isMarked = true;
+      break;
+    default:
+      break;
+  }
+}
+
+// Free the unmarked old objects. The rest stay marked.
+static void sweepOld() {
   Obj* previous = NULL;
   Obj* object = vm.objects;
   while (object != NULL) {
     if (object->isMarked) {
-      object->isMarked = false;
       previous = object;
       object = object->next;
     } else {
@@ -332,18 +450,76 @@ static void sweep() {
   }
 }
 
+// Free the unmarked young objects and promote the rest.
+static void sweepYoung() {
+  Obj* object = vm.young;
+  while (object != NULL) {
+    Obj* next = object->next;
+    if (object->isMarked) {
+      promoteMaps(object);
+      object->next = vm.objects;
+      vm.objects = object;
+    } else {
+      freeObject(object);
+    }
+    object = next;
+  }
+  vm.young = NULL;
+}
+
+// Collect the young generation only. The old objects are still
+// marked from the last collection, so tracing stops at them, and
+// those written a young reference since are in the remembered set.
+static void collectYoung() {
+#ifdef DEBUG_LOG_GC
+  printf("-- minor gc begin\n");
+  size_t before = vm.bytesAllocated;
+#endif
+  clock_t start = clock();
+
+  markRoots();
+  traceRemembered();
+  traceReferences();
+  mapRemoveWhite(&vm.strings);
+  annotationsRemoveWhite(&vm.annotations);
+  forgetRemembered();
+  sweepYoung();
+
+  vm.nextYoungGC = vm.bytesAllocated + NURSERY_SIZE;
+  minorCollections++;
+  minorTime += clock() - start;
+
+#ifdef DEBUG_LOG_GC
+  printf("-- minor gc end\n");
+  printf("   collected %zu bytes (from %zu to %zu) next at %zu\n",
+         before - vm.bytesAllocated, before, vm.bytesAllocated,
+         vm.nextYoungGC);
+#endif
+}
+
+// Collect both generations, tracing everything from the roots.
 void collectGarbage() {
 #ifdef DEBUG_LOG_GC
   printf("-- gc begin\n");
   size_t before = vm.bytesAllocated;
 #endif
+  clock_t start = clock();
+
+  for (Obj* object = vm.objects; object != NULL; object = object->next)
+    object->isMarked = false;
 
   markRoots();
   traceReferences();
   mapRemoveWhite(&vm.strings);
-  sweep();
+  annotationsRemoveWhite(&vm.annotations);
+  forgetRemembered();
+  sweepOld();
+  sweepYoung();
 
   vm.nextGC = vm.bytesAllocated * GC_HEAP_GROW_FACTOR;
+  vm.nextYoungGC = vm.bytesAllocated + NURSERY_SIZE;
+  majorCollections++;
+  majorTime += clock() - start;
 
 #ifdef DEBUG_LOG_GC
   printf("-- gc end\n");
@@ -352,12 +528,23 @@ void collectGarbage() {
 #endif
 }
 
-void freeObjects() {
-  Obj* object = vm.objects;
+static void freeList(Obj* object) {
   while (object != NULL) {
     Obj* next = object->next;
     freeObject(object);
     object = next;
   }
+}
+
+void freeObjects() {
+  freeList(vm.objects);
+  freeList(vm.young);
   free(vm.grayStack);
+  free(vm.remembered);
+}
+
+void printGarbageStats() {
+  printf("gc: %d minor collections (%.3fs), %d major (%.3fs).\n",
+         minorCollections, (double)minorTime / CLOCKS_PER_SEC,
+         majorCollections, (double)majorTime / CLOCKS_PER_SEC);
 }
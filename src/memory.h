@@ -17,10 +17,23 @@
 #define FREE_ARRAY(type, pointer, oldCount) \
   reallocate(pointer, sizeof(type) * (oldCount), 0)
 
+// the bytes allocated between minor collections.
+#define NURSERY_SIZE (256 * 1024)
+
 void* reallocate(void* pointer, size_t oldSize, size_t newSize);
 void markObject(Obj* object);
 void markValue(Value value);
+void rememberObject(Obj* object);
 void collectGarbage();
 void freeObjects();
+void printGarbageStats();
+
+// A minor collection only traces the old objects it remembers,
+// so an old [owner] must be remembered once it's written a
+// reference to a young [value].
+static inline void writeBarrier(Obj* owner, Value value) {
+  if (owner->isMarked && IS_OBJ(value) && !AS_OBJ(value)->isMarked)
+    rememberObject(owner);
+}
 
 #endif
\ No newline at end of file
@@ -18,10 +18,10 @@ static Obj* allocateObject(size_t size, ObjType type) {
 
   object->oType = type;
   object->isMarked = false;
-  object->next = vm.objects;
+  object->next = vm.young;
+  object->flags = 0;
   object->hash = 0;
-  initValueArray(&object->annotations);
-  vm.objects = object;
+  vm.young = object;
 
 #ifdef DEBUG_LOG_GC
   printf("%p allocate %zu for %d\n", (void*)object, size, type);
@@ -46,10 +46,35 @@ ObjBoundFunction* newBoundNative(Value receiver, ObjNative* native) {
   return obj;
 }
 
+static uint32_t shapeIds = 0;
+
+static Shape* newShape(Shape* parent, ObjString* name) {
+  Shape* shape = ALLOCATE(Shape, 1);
+  shape->id = ++shapeIds;
+  shape->name = name;
+  shape->slot = parent == NULL ? -1 : parent->count;
+  shape->count = parent == NULL ? 0 : parent->count + 1;
+  shape->parent = parent;
+  shape->transitions = NULL;
+  shape->transitionCount = 0;
+  shape->transitionCapacity = 0;
+  return shape;
+}
+
 ObjClass* newClass(ObjString* name) {
+  // the root shape isn't collected, so allocate it
+  // before the class that will own it.
+  Shape* shape = newShape(NULL, NULL);
+  ObjClass** ancestors = ALLOCATE(ObjClass*, 1);
+
   ObjClass* klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
   klass->name = name;
   klass->super = NULL;
+  klass->ancestors = ancestors;
+  klass->ancestors[0] = klass;
+  klass->depth = 0;
+  klass->shape = shape;
+  for (int i = 0; i < PROTOCOL_COUNT; i++) klass->protocol[i] = UNDEF_VAL;
   initMap(&klass->fields);
   return klass;
 }
@@ -62,6 +87,7 @@ ObjClosure* newClosure(ObjFunction* function) {
   closure->function = function;
   closure->upvalues = upvalues;
   closure->upvalueCount = function->upvalueCount;
+  closure->dispatch = NULL;
   return closure;
 }
 
@@ -84,6 +110,7 @@ ObjOverload* newOverload(int cases) {
   ObjOverload* overload = ALLOCATE_OBJ(ObjOverload, OBJ_OVERLOAD);
   overload->closures = closures;
   overload->cases = cases;
+  overload->dispatch = NULL;
   initMap(&overload->fields);
   return overload;
 }
@@ -100,7 +127,12 @@ ObjFunction* newFunction(ObjModule* module) {
   function->arity = 0;
   function->variadic = false;
   function->patterned = false;
+  function->params = NULL;
+  function->paramCount = 0;
   function->upvalueCount = 0;
+  function->locals = NULL;
+  function->localCount = 0;
+  function->localCapacity = 0;
   function->name = NULL;
   function->module = NULL;
   function->module = module;
@@ -113,6 +145,9 @@ ObjFunction* newFunction(ObjModule* module) {
 ObjInstance* newInstance(ObjClass* klass) {
   ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
   instance->klass = klass;
+  instance->shape = klass->shape;
+  instance->slots = NULL;
+  instance->slotCapacity = 0;
   initMap(&instance->fields);
   return instance;
 }
@@ -199,16 +234,33 @@ ObjString* intern(const char* chars) {
   return copyString(chars, strlen(chars));
 }
 
-ObjUpvalue* newUpvalue(Value* value, uint8_t slot, ObjString* name) {
+ObjUpvalue* newUpvalue(Value* value, uint8_t slot, int offset,
+                       ObjFunction* function) {
   ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
   upvalue->location = value;
   upvalue->slot = slot;
+  upvalue->offset = offset;
   upvalue->closed = NIL_VAL;
   upvalue->next = NULL;
-  upvalue->name = name;
+  upvalue->function = function;
   return upvalue;
 }
 
+// The name of the local in [slot] of [function] at [offset] in
+// its chunk: the latest declared there before that offset.
+ObjString* localName(ObjFunction* function, int slot, int offset) {
+  for (int i = function->localCount - 1; i >= 0; i--) {
+    LocalName* local = &function->locals[i];
+    if (local->slot == slot && local->offset <= offset)
+      return copyString(local->start, local->length);
+  }
+  return copyString("", 0);
+}
+
+ObjString* upvalueName(ObjUpvalue* upvalue) {
+  return localName(upvalue->function, upvalue->slot, upvalue->offset);
+}
+
 ObjSpread* newSpread(Value value) {
   ObjSpread* spread = ALLOCATE_OBJ(ObjSpread, OBJ_SPREAD);
   spread->value = value;
@@ -216,6 +268,11 @@ ObjSpread* newSpread(Value value) {
 }
 
 void initMap(ObjMap* map) {
+  // a map embedded in another object only uses its header
+  // to carry the owner's age for the write barrier.
+  map->obj.oType = OBJ_MAP;
+  map->obj.isMarked = false;
+  map->obj.flags = 0;
   map->count = 0;
   map->capacity = 0;
   map->entries = NULL;
@@ -308,6 +365,14 @@ bool mapGet(ObjMap* map, Value key, Value* value) {
   return mapGetHash(map, key, value, hashValue(key));
 }
 
+// The live entry for [key] in [map], or NULL if there isn't one.
+MapEntry* mapGetEntry(ObjMap* map, Value key) {
+  if (map->count == 0) return NULL;
+
+  MapEntry* entry = mapFindEntry(map->entries, map->capacity, key);
+  return IS_UNDEF(entry->key) ? NULL : entry;
+}
+
 bool mapSetHash(ObjMap* map, Value key, Value value, uint32_t hash) {
   if (map->count + 1 > map->capacity * MAP_MAX_LOAD) {
     int capacity = GROW_CAPACITY(map->capacity);
@@ -321,6 +386,8 @@ bool mapSetHash(ObjMap* map, Value key, Value value, uint32_t hash) {
 
   entry->key = key;
   entry->value = value;
+  writeBarrier(&map->obj, key);
+  writeBarrier(&map->obj, value);
   return isNewKey;
 }
 
@@ -390,31 +457,274 @@ void markMap(ObjMap* map) {
   }
 }
 
-static void printMap(ObjMap* map) { printf("<map>"); }
+void initAnnotationTable(AnnotationTable* table) {
+  table->count = 0;
+  table->capacity = 0;
+  table->entries = NULL;
+}
 
-// Is [a] a subclass of [b]?
-bool isSubclass(ObjClass* a, ObjClass* b) {
-  ObjClass* k = a;
-  while (k != NULL) {
-    if (k == b) return true;
-    k = k->super;
+void freeAnnotationTable(AnnotationTable* table) {
+  for (int i = 0; i < table->capacity; i++)
+    freeValueArray(&table->entries[i].annotations);
+  FREE_ARRAY(Annotations, table->entries, table->capacity);
+  initAnnotationTable(table);
+}
+
+// marks the slot of an entry that was removed.
+static Obj annotationTombstone;
+#define TOMBSTONE (&annotationTombstone)
+
+static uint32_t hashAddress(Obj* object) {
+  uint64_t address = (uintptr_t)object;
+  return (uint32_t)((address >> 3) * 2654435761u);
+}
+
+// The entry for [object], or the slot where it would go.
+static Annotations* findAnnotations(Annotations* entries, int capacity,
+                                    Obj* object) {
+  uint32_t index = hashAddress(object) & (capacity - 1);
+  Annotations* tombstone = NULL;
+
+  for (;;) {
+    Annotations* entry = &entries[index];
+    if (entry->object == NULL)
+      return tombstone != NULL ? tombstone : entry;
+    if (entry->object == TOMBSTONE) {
+      if (tombstone == NULL) tombstone = entry;
+    } else if (entry->object == object) {
+      return entry;
+    }
+
+    index = (index + 1) & (capacity - 1);
+  }
+}
+
+static void growAnnotationTable(AnnotationTable* table) {
+  int capacity = GROW_CAPACITY(table->capacity);
+  Annotations* entries = ALLOCATE(Annotations, capacity);
+  for (int i = 0; i < capacity; i++) {
+    entries[i].object = NULL;
+    initValueArray(&entries[i].annotations);
+  }
+
+  table->count = 0;
+  for (int i = 0; i < table->capacity; i++) {
+    Annotations* entry = &table->entries[i];
+    if (entry->object == NULL || entry->object == TOMBSTONE) continue;
+
+    *findAnnotations(entries, capacity, entry->object) = *entry;
+    table->count++;
+  }
+
+  FREE_ARRAY(Annotations, table->entries, table->capacity);
+  table->entries = entries;
+  table->capacity = capacity;
+}
+
+ValueArray* objectAnnotations(Obj* object) {
+  if (!(object->flags & OBJ_ANNOTATED)) return NULL;
+
+  AnnotationTable* table = &vm.annotations;
+  return &findAnnotations(table->entries, table->capacity, object)
+              ->annotations;
+}
+
+int annotationCount(Obj* object) {
+  ValueArray* annotations = objectAnnotations(object);
+  return annotations == NULL ? 0 : annotations->count;
+}
+
+void annotateObject(Obj* object, Value annotation) {
+  AnnotationTable* table = &vm.annotations;
+
+  // growing may collect, so keep both reachable.
+  vmPush(OBJ_VAL(object));
+  vmPush(annotation);
+
+  if (!(object->flags & OBJ_ANNOTATED)) {
+    if (table->count + 1 > table->capacity * MAP_MAX_LOAD)
+      growAnnotationTable(table);
+
+    Annotations* entry =
+        findAnnotations(table->entries, table->capacity, object);
+    if (entry->object == NULL) table->count++;
+    entry->object = object;
+    object->flags |= OBJ_ANNOTATED;
+  }
+
+  writeValueArray(objectAnnotations(object), annotation);
+  writeBarrier(object, annotation);
+
+  vmPop();
+  vmPop();
+}
+
+// Drop the entries of objects that are about to be swept.
+void annotationsRemoveWhite(AnnotationTable* table) {
+  for (int i = 0; i < table->capacity; i++) {
+    Annotations* entry = &table->entries[i];
+    if (entry->object == NULL || entry->object == TOMBSTONE ||
+        entry->object->isMarked)
+      continue;
+
+    freeValueArray(&entry->annotations);
+    entry->object = TOMBSTONE;
   }
-  return false;
 }
 
-bool leastCommonAncestor(ObjClass* a, ObjClass* b, ObjClass* ancestor) {
-  ObjClass* k = a;
+void freeShape(Shape* shape) {
+  for (int i = 0; i < shape->transitionCount; i++)
+    freeShape(shape->transitions[i]);
+  FREE_ARRAY(Shape*, shape->transitions, shape->transitionCapacity);
+  FREE(Shape, shape);
+}
+
+void markShape(Shape* shape) {
+  markObject((Obj*)shape->name);
+  for (int i = 0; i < shape->transitionCount; i++)
+    markShape(shape->transitions[i]);
+}
+
+// The slot of [name] in [shape], or -1 if it has no such field.
+int shapeSlot(Shape* shape, ObjString* name) {
+  for (Shape* s = shape; s->parent != NULL; s = s->parent)
+    if (s->name == name) return s->slot;
+  return -1;
+}
+
+static Shape* shapeTransition(Shape* shape, ObjString* name) {
+  for (int i = 0; i < shape->transitionCount; i++)
+    if (shape->transitions[i]->name == name) return shape->transitions[i];
 
-  while (k != NULL) {
-    if (isSubclass(b, k)) {
-      *ancestor = *k;
-      return true;
+  if (shape->transitionCapacity < shape->transitionCount + 1) {
+    int oldCapacity = shape->transitionCapacity;
+    shape->transitionCapacity = GROW_CAPACITY(oldCapacity);
+    shape->transitions = GROW_ARRAY(Shape*, shape->transitions, oldCapacity,
+                                    shape->transitionCapacity);
+  }
+
+  Shape* next = newShape(shape, name);
+  shape->transitions[shape->transitionCount++] = next;
+  return next;
+}
+
+bool instanceGetHash(ObjInstance* instance, Value key, Value* value,
+                     uint32_t hash) {
+  if (instance->shape == NULL)
+    return mapGetHash(&instance->fields, key, value, hash);
+  if (!IS_STRING(key)) return false;
+
+  int slot = shapeSlot(instance->shape, AS_STRING(key));
+  if (slot == -1) return false;
+
+  *value = instance->slots[slot];
+  return true;
+}
+
+bool instanceGet(ObjInstance* instance, Value key, Value* value) {
+  if (instance->shape == NULL) return mapGet(&instance->fields, key, value);
+  return instanceGetHash(instance, key, value, 0);
+}
+
+bool instanceHasHash(ObjInstance* instance, Value key, uint32_t hash) {
+  Value value;
+  return instanceGetHash(instance, key, &value, hash);
+}
+
+void instanceSet(ObjInstance* instance, Value key, Value value) {
+  if (instance->shape != NULL && IS_STRING(key)) {
+    int slot = shapeSlot(instance->shape, AS_STRING(key));
+    if (slot != -1) {
+      instance->slots[slot] = value;
+      writeBarrier((Obj*)instance, value);
+      return;
+    }
+  }
+
+  // growing may collect, so keep the new field reachable.
+  vmPush(key);
+  vmPush(value);
+
+  if (instance->shape != NULL && IS_STRING(key) &&
+      instance->shape->count < SHAPE_MAX_FIELDS) {
+    Shape* shape = shapeTransition(instance->shape, AS_STRING(key));
+
+    if (instance->slotCapacity < shape->count) {
+      int oldCapacity = instance->slotCapacity;
+      instance->slotCapacity = oldCapacity < 4 ? 4 : oldCapacity * 2;
+      instance->slots = GROW_ARRAY(Value, instance->slots, oldCapacity,
+                                   instance->slotCapacity);
     }
 
-    k = k->super;
+    instance->slots[shape->slot] = value;
+    instance->shape = shape;
+    writeBarrier((Obj*)instance, value);
+    // the new shape's name is held by the class's shape tree.
+    writeBarrier((Obj*)instance->klass, key);
+  } else {
+    mapSet(instanceFields(instance), key, value);
+  }
+
+  vmPop();
+  vmPop();
+}
+
+int instanceCount(ObjInstance* instance) {
+  if (instance->shape == NULL) return instance->fields.count;
+  return instance->shape->count;
+}
+
+// Move [instance] to dictionary mode and return the map
+// that now holds its fields.
+ObjMap* instanceFields(ObjInstance* instance) {
+  if (instance->shape == NULL) return &instance->fields;
+
+  // the slots stay marked until every field is in the map.
+  for (Shape* s = instance->shape; s->parent != NULL; s = s->parent)
+    mapSet(&instance->fields, OBJ_VAL(s->name), instance->slots[s->slot]);
+
+  instance->shape = NULL;
+  FREE_ARRAY(Value, instance->slots, instance->slotCapacity);
+  instance->slots = NULL;
+  instance->slotCapacity = 0;
+  return &instance->fields;
+}
+
+static void printMap(ObjMap* map) { printf("<map>"); }
+
+// Is [a] a subclass of [b]?
+void inheritClass(ObjClass* subclass, ObjClass* superclass) {
+  int depth = superclass->depth + 1;
+  subclass->ancestors = GROW_ARRAY(ObjClass*, subclass->ancestors,
+                                   subclass->depth + 1, depth + 1);
+  memcpy(subclass->ancestors, superclass->ancestors,
+         sizeof(ObjClass*) * depth);
+  subclass->ancestors[depth] = subclass;
+  subclass->depth = depth;
+  subclass->super = superclass;
+  writeBarrier((Obj*)subclass, OBJ_VAL(superclass));
+}
+
+bool isSubclass(ObjClass* a, ObjClass* b) {
+  return b->depth <= a->depth && a->ancestors[b->depth] == b;
+}
+
+ObjClass* leastCommonAncestor(ObjClass* a, ObjClass* b) {
+  if (a->ancestors[0] != b->ancestors[0]) return NULL;
+
+  // the two lines of ancestry agree down to the lca
+  // and differ below it, so bisect for the last match.
+  int lo = 0;
+  int hi = a->depth < b->depth ? a->depth : b->depth;
+  while (lo < hi) {
+    int mid = (lo + hi + 1) / 2;
+    if (a->ancestors[mid] == b->ancestors[mid])
+      lo = mid;
+    else
+      hi = mid - 1;
   }
 
-  return false;
+  return a->ancestors[lo];
 }
 
 void printObject(Value value) {
@@ -63,14 +63,39 @@ typedef enum {
 
 typedef struct ObjModule ObjModule;
 
+// set on objects that have an entry in the vm's annotation table.
+#define OBJ_ANNOTATED 0x1
+// set on old objects in the remembered set.
+#define OBJ_REMEMBERED 0x2
+
+#define IS_ANNOTATED(value) \
+  (IS_OBJ(value) && (AS_OBJ(value)->flags & OBJ_ANNOTATED))
+
 struct Obj {
-  ObjType oType;
+  uint8_t oType;
+  // old objects stay marked between collections, so a minor
+  // collection's marking stops at them.
   bool isMarked;
+  uint8_t flags;
   uint32_t hash;
   struct Obj *next;
-  ValueArray annotations;
 };
 
+// few objects are ever annotated, so their annotations live
+// in a side table keyed on the object's address rather than
+// in every object's header. the table is weak: an entry goes
+// when its object is collected.
+typedef struct {
+  Obj *object;
+  ValueArray annotations;
+} Annotations;
+
+typedef struct {
+  int count;
+  int capacity;
+  Annotations *entries;
+} AnnotationTable;
+
 typedef struct {
   Value key;
   Value value;
@@ -94,16 +119,52 @@ typedef struct {
   ObjString *name;
 } ObjVariable;
 
+// how a parameter of a function's signature matches an argument.
+typedef enum {
+  // an untyped variable, which matches anything.
+  MATCH_ANY,
+  // a constant literal, which matches values equal to it.
+  MATCH_CONSTANT,
+  // a variable annotated with a global, which matches
+  // instances of the class the global names.
+  MATCH_CLASS,
+  // a literal that may not be a constant.
+  MATCH_LITERAL,
+  // any other annotation.
+  MATCH_TYPE,
+} MatchKind;
+
+typedef struct {
+  MatchKind kind;
+  // the constant, or the name of the global.
+  Value operand;
+} ParamMatch;
+
+// a local as the compiled function remembers it: the span
+// of its name in the module's source, its slot, and the
+// offset in the chunk from which the slot holds it.
+typedef struct {
+  const char *start;
+  int length;
+  int slot;
+  int offset;
+} LocalName;
+
 typedef struct {
   Obj obj;
   int arity;
   bool variadic;
   bool patterned;
+  // how each parameter of the signature matches, in order.
+  ParamMatch *params;
+  int paramCount;
   int upvalueCount;
 
   Chunk chunk;
-  Local locals[UINT8_COUNT];
+  // every local the function declares, in order, for reflection.
+  LocalName *locals;
   int localCount;
+  int localCapacity;
 
   ObjMap fields;
   ObjString *name;
@@ -114,7 +175,9 @@ typedef struct {
   ObjMap constants;
 } ObjFunction;
 
-typedef bool (*NativeFn)(int argCount, Value *args);
+// natives find their [argCount] arguments on top of the stack,
+// which may move if they call back into the vm.
+typedef bool (*NativeFn)(int argCount);
 
 typedef struct {
   Obj obj;
@@ -130,17 +193,65 @@ typedef struct ObjUpvalue {
   Value *location;
   Value closed;
   struct ObjUpvalue *next;
-  // the address of the local that's closed over.
-  // we stash this only to reconstruct the ast.
+  // the address of the local that's closed over, the offset
+  // it was captured at, and the function it belongs to. we
+  // stash these only to name the upvalue when we reconstruct
+  // the ast.
   uint8_t slot;
-  ObjString *name;
+  int offset;
+  ObjFunction *function;
 } ObjUpvalue;
 
+// calls with more arguments than this aren't cached.
+#define DISPATCH_ARGS_MAX 8
+#define DISPATCH_ENTRIES 8
+
+// how an argument's descriptor in a dispatch key was taken.
+typedef enum {
+  // the argument itself.
+  DISPATCH_VALUE,
+  // the class of an instance.
+  DISPATCH_CLASS,
+  // the vm type of a primitive or string.
+  DISPATCH_TYPE,
+} DispatchKind;
+
+// the descriptors of a call's arguments.
+typedef struct {
+  int argCount;
+  uint8_t kinds[DISPATCH_ARGS_MAX];
+  Value types[DISPATCH_ARGS_MAX];
+} DispatchKey;
+
+// the case that arguments with the key's descriptors
+// selected, or -1 if none did.
+typedef struct {
+  DispatchKey key;
+  int match;
+} DispatchEntry;
+
+// a small cache from the types of a call's arguments to the
+// case of an overload or patterned function they select.
+typedef struct {
+  // the vm's dispatch epoch when the entries were made.
+  int epoch;
+  // the argument positions some case matches by a literal,
+  // and those where the literal isn't a constant.
+  uint32_t patterns;
+  uint32_t opaquePatterns;
+  int count;
+  // the entry to replace once the cache is full.
+  int next;
+  DispatchEntry entries[DISPATCH_ENTRIES];
+} Dispatch;
+
 typedef struct {
   Obj obj;
   ObjFunction *function;
   ObjUpvalue **upvalues;
   int upvalueCount;
+  // allocated the first time a patterned closure is called.
+  Dispatch *dispatch;
 } ObjClosure;
 
 typedef struct {
@@ -148,18 +259,73 @@ typedef struct {
   int cases;
   ObjClosure **closures;
   ObjMap fields;
+  Dispatch *dispatch;
 } ObjOverload;
 
+// a shape maps the field names of an instance to slots in its
+// field array. each class roots a tree of shapes, and adding a
+// field moves an instance along the transition for that name,
+// so instances that gain the same fields in the same order share
+// a shape.
+typedef struct Shape {
+  // unique for the lifetime of the vm, so caches can key on it.
+  uint32_t id;
+  // the field added by the transition into this shape, and its
+  // slot. the root has no name.
+  ObjString *name;
+  int slot;
+  // the number of fields an instance of this shape holds.
+  int count;
+  struct Shape *parent;
+  struct Shape **transitions;
+  int transitionCount;
+  int transitionCapacity;
+} Shape;
+
+// instances with more fields than this fall back to a map.
+#define SHAPE_MAX_FIELDS 64
+
+// the methods the vm looks up on its own, by their slot
+// in a class's protocol table.
+typedef enum {
+  PROTOCOL_EQ,
+  PROTOCOL_IN,
+  PROTOCOL_GET,
+  PROTOCOL_SET,
+  PROTOCOL_CALL,
+  PROTOCOL_LEN,
+  PROTOCOL_HASH,
+  PROTOCOL_MORE,
+  PROTOCOL_NEXT,
+  PROTOCOL_ADD,
+  PROTOCOL_COUNT,
+} Protocol;
+
 typedef struct ObjClass {
   Obj obj;
   ObjString *name;
   ObjMap fields;
   struct ObjClass *super;
+  // the class's superclasses from the root down, ending with the
+  // class itself, so [ancestors][i] is its ancestor at depth i.
+  struct ObjClass **ancestors;
+  int depth;
+  Shape *shape;
+  // a mirror of the protocol methods in [fields], undefined
+  // where the class has none. kept in step by vmClassSet.
+  Value protocol[PROTOCOL_COUNT];
 } ObjClass;
 
 typedef struct {
   Obj obj;
   ObjClass *klass;
+  // instances store their fields in [slots] as laid out by [shape].
+  // once one is given a key that isn't a name, such as a Map's
+  // arbitrary keys, it moves to dictionary mode: [shape] is NULL
+  // and its fields live in [fields] instead.
+  Shape *shape;
+  Value *slots;
+  int slotCapacity;
   ObjMap fields;
 } ObjInstance;
 
@@ -197,6 +363,13 @@ typedef struct {
   Value value;
 } ObjSpread;
 
+void initAnnotationTable(AnnotationTable *table);
+void freeAnnotationTable(AnnotationTable *table);
+ValueArray *objectAnnotations(Obj *object);
+int annotationCount(Obj *object);
+void annotateObject(Obj *object, Value annotation);
+void annotationsRemoveWhite(AnnotationTable *table);
+
 ObjBoundFunction *newBoundMethod(Value receiver, ObjClosure *method);
 ObjBoundFunction *newBoundNative(Value receiver, ObjNative *native);
 ObjClass *newClass(ObjString *name);
@@ -214,7 +387,10 @@ ObjString *takeString(char *chars, int length);
 ObjString *copyString(const char *chars, int length);
 ObjString *concatenateStrings(ObjString *a, ObjString *b);
 ObjString *intern(const char *chars);
-ObjUpvalue *newUpvalue(Value *value, uint8_t slot, ObjString *name);
+ObjUpvalue *newUpvalue(Value *value, uint8_t slot, int offset,
+                       ObjFunction *function);
+ObjString *localName(ObjFunction *function, int slot, int offset);
+ObjString *upvalueName(ObjUpvalue *upvalue);
 ObjSpread *newSpread(Value value);
 
 void printObject(Value value);
@@ -229,6 +405,7 @@ bool mapHas(ObjMap *map, Value key);
 bool mapHasHash(ObjMap *map, Value key, uint32_t hash);
 bool mapGet(ObjMap *map, Value key, Value *value);
 bool mapGetHash(ObjMap *map, Value key, Value *value, uint32_t hash);
+MapEntry *mapGetEntry(ObjMap *map, Value key);
 bool mapSet(ObjMap *map, Value key, Value value);
 bool mapSetHash(ObjMap *map, Value key, Value value, uint32_t hash);
 bool mapDelete(ObjMap *map, Value key);
@@ -238,5 +415,17 @@ ObjString *mapFindString(ObjMap *map, const char *chars, int length,
                          uint32_t hash);
 void mapRemoveWhite(ObjMap *map);
 void markMap(ObjMap *map);
-bool leastCommonAncestor(ObjClass *a, ObjClass *b, ObjClass *ancestor);
+void freeShape(Shape *shape);
+void markShape(Shape *shape);
+int shapeSlot(Shape *shape, ObjString *name);
+bool instanceGet(ObjInstance *instance, Value key, Value *value);
+bool instanceGetHash(ObjInstance *instance, Value key, Value *value,
+                     uint32_t hash);
+bool instanceHasHash(ObjInstance *instance, Value key, uint32_t hash);
+void instanceSet(ObjInstance *instance, Value key, Value value);
+int instanceCount(ObjInstance *instance);
+ObjMap *instanceFields(ObjInstance *instance);
+void inheritClass(ObjClass *subclass, ObjClass *superclass);
+bool isSubclass(ObjClass *a, ObjClass *b);
+ObjClass *leastCommonAncestor(ObjClass *a, ObjClass *b);
 #endif
\ No newline at end of file
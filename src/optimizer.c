@@ -0,0 +1,303 @@
+#include "optimizer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "memory.h"
+#include "object.h"
+
+// instruction counts over every chunk optimized, for --stats.
+static int chunksOptimized = 0;
+static int instructionsBefore = 0;
+static int instructionsAfter = 0;
+static int bytesAfter = 0;
+static int lineRuns = 0;
+
+static uint16_t readShort(Chunk* chunk, int offset) {
+  return (uint16_t)(chunk->code[offset] << 8) | chunk->code[offset + 1];
+}
+
+static void writeShort(Chunk* chunk, int offset, int value) {
+  chunk->code[offset] = (value >> 8) & 0xff;
+  chunk->code[offset + 1] = value & 0xff;
+}
+
+// The length of the instruction at [offset], operands included.
+static int instructionLength(Chunk* chunk, int offset) {
+  switch (chunk->code[offset]) {
+    case OP_CALL:
+    case OP_CALL_SPREAD:
+    case OP_CALL_POSTFIX:
+    case OP_TAIL_CALL:
+    case OP_POPN:
+      return 2;
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_SET_LOCAL:
+    case OP_DEFINE_GLOBAL:
+    case OP_GET_GLOBAL:
+    case OP_SET_GLOBAL:
+    case OP_GET_UPVALUE:
+    case OP_SET_UPVALUE:
+    case OP_GET_PROPERTY:
+    case OP_SET_PROPERTY:
+    case OP_GET_SUPER:
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+    case OP_CALL_INFIX:
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    case OP_LT:
+    case OP_GT:
+    case OP_LTE:
+    case OP_GTE:
+    case OP_COMPREHENSION_PRED:
+    case OP_VARIABLE:
+    case OP_CLASS:
+    case OP_METHOD:
+    case OP_IMPORT:
+    case OP_SET_TYPE_LOCAL:
+    case OP_SET_TYPE_GLOBAL:
+    case OP_SET_LOCAL_POP:
+    case OP_SET_GLOBAL_POP:
+      return 3;
+    case OP_INVOKE:
+    case OP_INVOKE_SPREAD:
+    case OP_OVERLOAD:
+    case OP_TAIL_INVOKE:
+      return 4;
+    case OP_ITER:
+    case OP_COMPREHENSION_ITER:
+    case OP_IMPORT_AS:
+    case OP_GET_LOCAL_PROPERTY:
+      return 5;
+    case OP_CLOSURE:
+    case OP_COMPREHENSION:
+    case OP_SIGN: {
+      // followed by a pair of bytes per upvalue.
+      Value function = chunk->constants.values[readShort(chunk, offset + 1)];
+      return 3 + 2 * AS_FUNCTION(function)->upvalueCount;
+    }
+    case OP_IMPORT_FROM:
+      // followed by a constant per imported name.
+      return 4 + 2 * chunk->code[offset + 3];
+    default:
+      return 1;
+  }
+}
+
+// The offset the instruction at [offset] may jump to, or -1.
+static int jumpTarget(Chunk* chunk, int offset) {
+  switch (chunk->code[offset]) {
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_COMPREHENSION_PRED:
+    case OP_ITER:
+    case OP_COMPREHENSION_ITER:
+      return offset + 3 + readShort(chunk, offset + 1);
+    case OP_LOOP:
+      return offset + 3 - readShort(chunk, offset + 1);
+    default:
+      return -1;
+  }
+}
+
+// Does the instruction only push a value, without side effects?
+static bool isPurePush(uint8_t instruction) {
+  switch (instruction) {
+    case OP_UNDEFINED:
+    case OP_CONSTANT:
+    case OP_NIL:
+    case OP_TRUE:
+    case OP_FALSE:
+    case OP_UNIT:
+    case OP_GET_LOCAL:
+    case OP_GET_UPVALUE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Rewrite [function]'s chunk in place: thread jumps that land on
+// jumps, drop values that are pushed only to be popped, and fuse
+// common pairs into superinstructions. Nothing a jump lands on is
+// removed or fused, so every jump still lands on the instruction it
+// did before, and [astInstruction] sees the same structure.
+void optimizeChunk(ObjFunction* function) {
+  Chunk* chunk = &function->chunk;
+  int bytes = chunk->count;
+  int* starts = ALLOCATE(int, bytes + 1);
+  int* indices = ALLOCATE(int, bytes + 1);
+
+  int count = 0;
+  for (int offset = 0; offset < chunk->count;
+       offset += instructionLength(chunk, offset)) {
+    indices[offset] = count;
+    starts[count++] = offset;
+  }
+  starts[count] = chunk->count;
+  indices[chunk->count] = count;
+
+  // the instruction each jump lands on, by index.
+  int* targets = ALLOCATE(int, count);
+  bool* landings = ALLOCATE(bool, count + 1);
+  int* moved = ALLOCATE(int, count + 1);
+
+  for (int i = 0; i < count; i++) {
+    int target = jumpTarget(chunk, starts[i]);
+    targets[i] = target == -1 ? -1 : indices[target];
+  }
+
+  // jumps only go forward, so a chain of them ends.
+  for (int i = 0; i < count; i++) {
+    if (chunk->code[starts[i]] != OP_JUMP) continue;
+    while (targets[i] < count && chunk->code[starts[targets[i]]] == OP_JUMP)
+      targets[i] = targets[targets[i]];
+  }
+
+  for (int i = 0; i <= count; i++) landings[i] = false;
+  for (int i = 0; i < count; i++)
+    if (targets[i] != -1) landings[targets[i]] = true;
+
+  // the rewrite never grows the code, so it stays behind
+  // the instructions it has yet to read.
+  int out = 0;
+  int emitted = 0;
+
+  // the line table is rebuilt as the code is, reading the
+  // old runs in step with [in].
+  LineRun* runs = chunk->lines;
+  int runCount = chunk->lineCount;
+  int runCapacity = chunk->lineCapacity;
+  int run = 0;
+  chunk->lines = NULL;
+  chunk->lineCount = 0;
+  chunk->lineCapacity = 0;
+
+  for (int i = 0; i < count;) {
+    int in = starts[i];
+    while (run + 1 < runCount && runs[run + 1].offset <= in) run++;
+    int line = runs[run].line;
+    uint8_t instruction = chunk->code[in];
+    uint8_t next = OP_UNDEFINED;
+    bool fusable = i + 1 < count && !landings[i] && !landings[i + 1];
+    if (fusable) next = chunk->code[starts[i + 1]];
+
+    moved[i] = out;
+
+    if (fusable && isPurePush(instruction) && next == OP_POP) {
+      moved[i + 1] = out;
+      i += 2;
+      continue;
+    }
+
+    if (fusable && instruction == OP_POP && next == OP_POP) {
+      int pops = 0;
+      while (i < count && pops < UINT8_MAX && !landings[i] &&
+             chunk->code[starts[i]] == OP_POP) {
+        moved[i++] = out;
+        pops++;
+      }
+
+      chunk->code[out] = OP_POPN;
+      chunk->code[out + 1] = pops;
+      writeLine(chunk, out, line);
+      out += 2;
+      emitted++;
+      continue;
+    }
+
+    uint8_t fused = OP_UNDEFINED;
+    if (fusable && instruction == OP_SET_LOCAL && next == OP_POP)
+      fused = OP_SET_LOCAL_POP;
+    if (fusable && instruction == OP_SET_GLOBAL && next == OP_POP)
+      fused = OP_SET_GLOBAL_POP;
+    if (fusable && instruction == OP_GET_LOCAL && next == OP_GET_PROPERTY)
+      fused = OP_GET_LOCAL_PROPERTY;
+
+    if (fused != OP_UNDEFINED) {
+      // the operands of both, in order.
+      uint8_t operands[4];
+      int length = 0;
+      for (int j = i; j < i + 2; j++)
+        for (int k = starts[j] + 1; k < starts[j + 1]; k++)
+          operands[length++] = chunk->code[k];
+
+      chunk->code[out] = fused;
+      memcpy(chunk->code + out + 1, operands, length);
+      writeLine(chunk, out, line);
+
+      moved[i + 1] = out;
+      out += 1 + length;
+      emitted++;
+      i += 2;
+      continue;
+    }
+
+    int length = starts[i + 1] - in;
+    memmove(chunk->code + out, chunk->code + in, length);
+    writeLine(chunk, out, line);
+
+    // a call whose result is returned as is can reuse the frame.
+    if (i + 1 < count && chunk->code[starts[i + 1]] == OP_RETURN) {
+      if (instruction == OP_CALL) chunk->code[out] = OP_TAIL_CALL;
+      if (instruction == OP_INVOKE) chunk->code[out] = OP_TAIL_INVOKE;
+    }
+    out += length;
+    emitted++;
+    i++;
+  }
+  moved[count] = out;
+
+  // the locals are declared in order, so their offsets
+  // move along with the code in a single pass.
+  for (int i = 0, j = 0; j < function->localCount; j++) {
+    LocalName* local = &function->locals[j];
+    while (i < count && starts[i] < local->offset) i++;
+    local->offset = moved[i];
+  }
+
+  // point the jumps at where their targets moved to.
+  for (int i = 0; i < count; i++) {
+    if (targets[i] == -1) continue;
+
+    int offset = moved[i];
+    int target = moved[targets[i]];
+    if (chunk->code[offset] == OP_LOOP)
+      writeShort(chunk, offset + 1, offset + 3 - target);
+    else
+      writeShort(chunk, offset + 1, target - offset - 3);
+  }
+
+  chunksOptimized++;
+  instructionsBefore += count;
+  instructionsAfter += emitted;
+  bytesAfter += out;
+  lineRuns += chunk->lineCount;
+  chunk->count = out;
+
+  FREE_ARRAY(LineRun, runs, runCapacity);
+
+  FREE_ARRAY(int, starts, bytes + 1);
+  FREE_ARRAY(int, indices, bytes + 1);
+  FREE_ARRAY(int, targets, count);
+  FREE_ARRAY(bool, landings, count + 1);
+  FREE_ARRAY(int, moved, count + 1);
+}
+
+void printOptimizerStats() {
+  int removed = instructionsBefore - instructionsAfter;
+  double percent =
+      instructionsBefore == 0 ? 0 : 100.0 * removed / instructionsBefore;
+
+  printf("optimized %d chunks: %d instructions before, %d after (-%.1f%%).\n",
+         chunksOptimized, instructionsBefore, instructionsAfter, percent);
+  printf("line tables: %d runs for %d bytes of code, %zu bytes (%zu at a line "
+         "per byte).\n",
+         lineRuns, bytesAfter, lineRuns * sizeof(LineRun),
+         bytesAfter * sizeof(int));
+}
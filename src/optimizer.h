@@ -0,0 +1,9 @@
+#ifndef nat_optimizer_h
+#define nat_optimizer_h
+
+#include "object.h"
+
+void optimizeChunk(ObjFunction* function);
+void printOptimizerStats();
+
+#endif
\ No newline at end of file
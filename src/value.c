@@ -39,7 +39,7 @@ bool findInValueArray(ValueArray* array, Value value) {
 }
 
 void printValue(Value value) {
-  switch (value.vmType) {
+  switch (VALUE_TYPE(value)) {
     case VAL_UNIT: {
       printf("()");
       break;
@@ -73,9 +73,15 @@ void printValueArray(ValueArray* array) {
 }
 
 bool valuesEqual(Value a, Value b) {
-  if (a.vmType != b.vmType) return false;
+#ifdef NAN_BOXING
+  // numbers compare as doubles and everything else but objects by bits.
+  if (IS_NUMBER(a) && IS_NUMBER(b)) return AS_NUMBER(a) == AS_NUMBER(b);
+  if (!IS_OBJ(a) || !IS_OBJ(b)) return a == b;
+#endif
 
-  switch (a.vmType) {
+  if (VALUE_TYPE(a) != VALUE_TYPE(b)) return false;
+
+  switch (VALUE_TYPE(a)) {
     case VAL_UNDEF:
     case VAL_UNIT:
     case VAL_NIL:
@@ -138,7 +144,7 @@ bool vHashable(Value value) {
 // Generates a hash code for [value], which must be one of
 // nil, bool, num, or string.
 uint32_t hashValue(Value value) {
-  switch (value.vmType) {
+  switch (VALUE_TYPE(value)) {
     case VAL_UNIT:
       return 4;
     case VAL_UNDEF:
@@ -2,6 +2,7 @@
 #define nat_value_h
 
 #include <math.h>
+#include <string.h>
 
 #include "common.h"
 
@@ -16,6 +17,79 @@ typedef enum {
   VAL_UNDEF
 } ValueType;
 
+#ifdef NAN_BOXING
+
+// Values are packed into the payload of a quiet NaN. Numbers are
+// every other double, objects set the sign bit, and singletons
+// are tagged in the low bits.
+
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN ((uint64_t)0x7ffc000000000000)
+
+#define TAG_NIL 1
+#define TAG_FALSE 2
+#define TAG_TRUE 3
+#define TAG_UNIT 4
+#define TAG_UNDEF 5
+
+typedef uint64_t Value;
+
+#define FALSE_VAL ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL ((Value)(uint64_t)(QNAN | TAG_TRUE))
+
+#define IS_UNIT(value) ((value) == UNIT_VAL)
+#define IS_BOOL(value) (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value) ((value) == NIL_VAL)
+#define IS_NUMBER(value) (((value) & QNAN) != QNAN)
+#define IS_INTEGER(value) \
+  (IS_NUMBER(value) && rintf(AS_NUMBER(value)) == AS_NUMBER(value))
+#define IS_OBJ(value) (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+#define IS_UNDEF(value) ((value) == UNDEF_VAL)
+
+#define AS_OBJ(value) ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+#define AS_BOOL(value) ((value) == TRUE_VAL)
+#define AS_NUMBER(value) valueToNum(value)
+
+#define UNIT_VAL ((Value)(uint64_t)(QNAN | TAG_UNIT))
+#define NIL_VAL ((Value)(uint64_t)(QNAN | TAG_NIL))
+#define BOOL_VAL(b) ((b) ? TRUE_VAL : FALSE_VAL)
+#define NUMBER_VAL(num) numToValue(num)
+#define OBJ_VAL(obj) (Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(obj))
+#define UNDEF_VAL ((Value)(uint64_t)(QNAN | TAG_UNDEF))
+
+static inline double valueToNum(Value value) {
+  double num;
+  memcpy(&num, &value, sizeof(Value));
+  return num;
+}
+
+static inline Value numToValue(double num) {
+  Value value;
+  memcpy(&value, &num, sizeof(double));
+  return value;
+}
+
+static inline ValueType valueType(Value value) {
+  if (IS_NUMBER(value)) return VAL_NUMBER;
+  if (IS_OBJ(value)) return VAL_OBJ;
+
+  switch (value & 7) {
+    case TAG_NIL:
+      return VAL_NIL;
+    case TAG_FALSE:
+    case TAG_TRUE:
+      return VAL_BOOL;
+    case TAG_UNIT:
+      return VAL_UNIT;
+    default:
+      return VAL_UNDEF;
+  }
+}
+
+#define VALUE_TYPE(value) valueType(value)
+
+#else
+
 typedef struct Value {
   ValueType vmType;
   union {
@@ -46,6 +120,10 @@ typedef struct Value {
 #define OBJ_VAL(object) ((Value){VAL_OBJ, {.obj = (Obj*)object}})
 #define UNDEF_VAL ((Value){VAL_UNDEF, {}})
 
+#define VALUE_TYPE(value) ((value).vmType)
+
+#endif
+
 typedef struct {
   int capacity;
   int count;
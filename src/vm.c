@@ -34,14 +34,14 @@ void vmRuntimeError(const char* format, ...) {
   int leftOffset = 0;
 
   for (int i = vm.frameCount - 1; i >= 0; i--) {
-    CallFrame* frame = &vm.frames[i];
+    CallFrame* frame = vmFrame(i);
     if (frame->closure->function->module->closure == frame->closure) continue;
     int fnNameLen = strlen(frame->closure->function->name->chars);
     if (fnNameLen > leftOffset) leftOffset = fnNameLen;
   }
 
   for (int i = vm.frameCount - 1; i >= 0; i--) {
-    CallFrame* frame = &vm.frames[i];
+    CallFrame* frame = vmFrame(i);
     ObjClosure* closure = frame->closure;
     ObjFunction* function = closure->function;
     size_t instruction = frame->ip - function->chunk.code - 1;
@@ -51,14 +51,14 @@ void vmRuntimeError(const char* format, ...) {
       fprintf(stderr, "        %*s %s/%s:%d\n", leftOffset, "in",
               function->module->dirName->chars,
               function->module->baseName->chars,
-              function->chunk.lines[instruction]);
+              chunkLine(&function->chunk, instruction));
 
     } else {
       // it's a function.
       fprintf(stderr, "  in %-*s at %s/%s:%d\n", leftOffset,
               function->name->chars, function->module->dirName->chars,
               function->module->baseName->chars,
-              function->chunk.lines[instruction]);
+              chunkLine(&function->chunk, instruction));
     }
   }
 
@@ -76,6 +76,8 @@ void initCore(Core* core) {
   core->sModule = NULL;
   core->sQuote = NULL;
   core->sBackslash = NULL;
+  core->sInner = NULL;
+  for (int i = 0; i < PROTOCOL_COUNT; i++) core->protocols[i] = NULL;
 
   core->sMain = NULL;
   core->sExecMain = NULL;
@@ -121,24 +123,44 @@ void initCore(Core* core) {
 }
 
 bool initVM() {
+  vm.stackCapacity = STACK_INITIAL;
+  vm.stack = (Value*)malloc(sizeof(Value) * vm.stackCapacity);
+  if (vm.stack == NULL) return false;
+  vm.frames = NULL;
+  vm.frameSegments = 0;
+  vm.framesMax = FRAMES_MAX;
+
   resetStack();
   vm.objects = NULL;
+  vm.young = NULL;
 
   vm.bytesAllocated = 0;
   vm.nextGC = 1024 * 1024;
+  vm.nextYoungGC = NURSERY_SIZE;
 
   vm.grayCount = 0;
   vm.grayCapacity = 0;
   vm.grayStack = NULL;
+  vm.rememberedCount = 0;
+  vm.rememberedCapacity = 0;
+  vm.remembered = NULL;
 
   vm.compiler = NULL;
   vm.module = NULL;
 
+  vm.nativeOperators = true;
+
+  vm.dispatchEpoch = 0;
+  vm.dispatchByValue = false;
+  for (int i = 0; i < INSTANTIATIONS; i++)
+    vm.instantiations[i].callee = NIL_VAL;
+
   vm.comprehensionDepth = 0;
   for (int i = 0; i < COMPREHENSION_DEPTH_MAX; i++) vm.comprehensions[i] = NULL;
 
   initMap(&vm.globals);
   initMap(&vm.strings);
+  initAnnotationTable(&vm.annotations);
   initMap(&vm.prefixes);
   initMap(&vm.infixes);
   initMap(&vm.methodInfixes);
@@ -152,11 +174,26 @@ bool initVM() {
   vm.core.sPatterned = intern("patterned");
   vm.core.sVariadic = intern("variadic");
   vm.core.sValues = intern("values");
+  vm.core.sSeq = intern("seq");
+  vm.core.sIdx = intern("idx");
+  vm.core.sEnd = intern("end");
   vm.core.sSignature = intern("signature");
   vm.core.sFunction = intern("function");
   vm.core.sModule = intern("__module__");
   vm.core.sQuote = intern("\"");
   vm.core.sBackslash = intern("\\");
+  vm.core.sInner = intern("inner");
+
+  vm.core.protocols[PROTOCOL_EQ] = intern(S_EQ);
+  vm.core.protocols[PROTOCOL_IN] = intern(S_IN);
+  vm.core.protocols[PROTOCOL_GET] = intern(S_SUBSCRIPT_GET);
+  vm.core.protocols[PROTOCOL_SET] = intern(S_SUBSCRIPT_SET);
+  vm.core.protocols[PROTOCOL_CALL] = intern(S_CALL);
+  vm.core.protocols[PROTOCOL_LEN] = intern(S_LEN);
+  vm.core.protocols[PROTOCOL_HASH] = intern(S_HASH);
+  vm.core.protocols[PROTOCOL_MORE] = intern(S_MORE);
+  vm.core.protocols[PROTOCOL_NEXT] = intern(S_NEXT);
+  vm.core.protocols[PROTOCOL_ADD] = intern(S_ADD);
 
   vm.core.sMain = intern("main");
   vm.core.sExecMain = intern("let out = main();");
@@ -170,6 +207,7 @@ bool initVM() {
 void freeVM() {
   freeMap(&vm.globals);
   freeMap(&vm.strings);
+  freeAnnotationTable(&vm.annotations);
   freeMap(&vm.prefixes);
   freeMap(&vm.infixes);
   freeMap(&vm.methodInfixes);
@@ -177,6 +215,36 @@ void freeVM() {
   initCore(&vm.core);
 
   freeObjects();
+
+  free(vm.stack);
+  for (int i = 0; i < vm.frameSegments; i++) free(vm.frames[i]);
+  free(vm.frames);
+}
+
+// Make room for [count] more values on the value stack, doubling
+// it as needed. Moving the stack means rebasing every pointer into
+// it: the stack top, the slots of each frame, and the open upvalues.
+static void reserveStack(int count) {
+  int used = vm.stackTop - vm.stack;
+  if (used + count <= vm.stackCapacity) return;
+
+  int capacity = vm.stackCapacity;
+  while (capacity < used + count) capacity *= 2;
+
+  Value* stack = (Value*)realloc(vm.stack, sizeof(Value) * capacity);
+  if (stack == NULL) exit(1);
+
+  for (int i = 0; i < vm.frameCount; i++) {
+    CallFrame* frame = vmFrame(i);
+    frame->slots = stack + (frame->slots - vm.stack);
+  }
+  for (ObjUpvalue* upvalue = vm.openUpvalues; upvalue != NULL;
+       upvalue = upvalue->next)
+    upvalue->location = stack + (upvalue->location - vm.stack);
+
+  vm.stack = stack;
+  vm.stackTop = stack + used;
+  vm.stackCapacity = capacity;
 }
 
 void vmPush(Value value) {
@@ -201,7 +269,7 @@ bool vmGetProperty(ObjString* name, int argCount, Value* method) {
     case OBJ_INSTANCE: {
       ObjInstance* instance = AS_INSTANCE(receiver);
 
-      if (mapGet(&instance->fields, OBJ_VAL(name), method))
+      if (instanceGet(instance, OBJ_VAL(name), method))
         return true;
       else
         return mapGet(&instance->klass->fields, OBJ_VAL(name), method);
@@ -230,16 +298,60 @@ bool vmInvoke(ObjString* name, int argCount) {
   return vmCallValue(method, argCount);
 }
 
+// Call [callee] and, if the call pushed a frame, run the
+// frame to completion so that the result is on the stack.
+// This is the only way native code re-enters the dispatch
+// loop; bytecode calls just push a frame and carry on.
+static bool callAndExecute(Value callee, int argCount) {
+  int baseFrame = vm.frameCount;
+  if (!vmCallValue(callee, argCount)) return false;
+
+  return vm.frameCount == baseFrame || vmExecute(baseFrame) == INTERPRET_OK;
+}
+
 bool vmExecuteMethod(char* name, int argCount) {
   Value receiver = vmPeek(argCount);
   Value method = NIL_VAL;
   if (!vmGetProperty(intern(name), argCount, &method)) return false;
   vm.stackTop[-argCount - 1] = receiver;
-  if (!vmCallValue(method, argCount)) return false;
 
-  int frames = IS_NATIVE(method) ? 0 : 1;
+  return callAndExecute(method, argCount);
+}
+
+// Write [value] to [klass]'s field [name], keeping the
+// class's protocol table in step.
+void vmClassSet(ObjClass* klass, Value name, Value value) {
+  mapSet(&klass->fields, name, value);
+  if (!IS_STRING(name)) return;
 
-  return (vmExecute(vm.frameCount - frames) == INTERPRET_OK);
+  for (int i = 0; i < PROTOCOL_COUNT; i++) {
+    if (AS_STRING(name) == vm.core.protocols[i]) {
+      klass->protocol[i] = value;
+      return;
+    }
+  }
+}
+
+// The [protocol] method that [receiver]'s class provides, unless
+// the receiver shadows it with a field of its own.
+static bool protocolMethod(Value receiver, Protocol protocol, Value* method) {
+  if (!IS_INSTANCE(receiver)) return false;
+
+  ObjInstance* instance = AS_INSTANCE(receiver);
+  *method = instance->klass->protocol[protocol];
+  if (IS_UNDEF(*method)) return false;
+
+  Value field;
+  return !instanceGet(instance, OBJ_VAL(vm.core.protocols[protocol]), &field);
+}
+
+// Like vmExecuteMethod, for a protocol method.
+static bool executeProtocol(Protocol protocol, int argCount) {
+  Value method;
+  if (protocolMethod(vmPeek(argCount), protocol, &method))
+    return callAndExecute(method, argCount);
+
+  return vmExecuteMethod(vm.core.protocols[protocol]->chars, argCount);
 }
 
 // If [value] is natively hashable, then hash it. Otherwise, if it's
@@ -259,7 +371,7 @@ bool vmHashValue(Value value, uint32_t* hash) {
   }
 
   vmPush(value);
-  if (!vmExecuteMethod(S_HASH, 0)) return false;
+  if (!executeProtocol(PROTOCOL_HASH, 0)) return false;
 
   if (!IS_NUMBER(vmPeek(0)) || AS_NUMBER(vmPeek(0)) < 0) {
     vmRuntimeError("'%s' function must return a natural number.", S_HASH);
@@ -274,16 +386,20 @@ bool vmHashValue(Value value, uint32_t* hash) {
 
 static bool vmExtendClass(ObjClass* subclass, ObjClass* superclass) {
   mapAddAll(&superclass->fields, &subclass->fields);
+  for (int i = 0; i < PROTOCOL_COUNT; i++) {
+    if (!IS_UNDEF(superclass->protocol[i]))
+      subclass->protocol[i] = superclass->protocol[i];
+  }
   mapSet(&subclass->fields, INTERN(S_SUPERCLASS), OBJ_VAL(superclass));
-  subclass->super = superclass;
+  inheritClass(subclass, superclass);
   return true;
 }
 
 static bool vmInstantiateClass(ObjClass* klass, int argCount) {
   Value initializer;
 
-  mapSet(&AS_INSTANCE(vmPeek(argCount))->fields, OBJ_VAL(intern(S_CLASS)),
-         OBJ_VAL(klass));
+  instanceSet(AS_INSTANCE(vmPeek(argCount)), OBJ_VAL(intern(S_CLASS)),
+              OBJ_VAL(klass));
 
   if (mapGet(&klass->fields, OBJ_VAL(intern(S_INIT)), &initializer)) {
     return vmCallValue(initializer, argCount);
@@ -295,15 +411,7 @@ static bool vmInstantiateClass(ObjClass* klass, int argCount) {
 }
 
 bool vmInitInstance(ObjClass* klass, int argCount) {
-  if (!vmCallValue(OBJ_VAL(klass), argCount)) return false;
-
-  Value method;
-  if (mapGet(&klass->fields, INTERN(S_INIT), &method)) {
-    int frames = IS_NATIVE(method) ? 0 : 1;
-    if (vmExecute(vm.frameCount - frames) != INTERPRET_OK) return false;
-  }
-
-  return true;
+  return callAndExecute(OBJ_VAL(klass), argCount);
 }
 
 static bool checkArity(ObjString* name, int arity, int argCount) {
@@ -314,127 +422,179 @@ static bool checkArity(ObjString* name, int arity, int argCount) {
   return false;
 }
 
-// Walk the frame delimited by [argCount] and expand any
-// [ObjSpread]s. (Note: maybe we could devise a way to do
-// this without shuffling the whole frame of arguments for
-// every function call.)
+// The values an argument contributes once spread: one for
+// an ordinary argument, or those of a spread sequence.
+static bool spreadValues(Value arg, Value** values, int* count) {
+  if (!IS_SPREAD(arg)) {
+    *count = 1;
+    return true;
+  }
+
+  Value vSeq;
+  if (!vmSequenceValueField(AS_INSTANCE(AS_SPREAD(arg)->value), &vSeq))
+    return false;
+
+  ObjSequence* seq = AS_SEQUENCE(vSeq);
+  *values = seq->values.values;
+  *count = seq->values.count;
+  return true;
+}
+
+// Expand the [ObjSpread]s among the top [argCount] values in
+// place. Spreads of fewer than two values can only shrink the
+// frame, so they go first, left to right; the rest can only
+// grow it, so they go right to left. Neither pass overwrites
+// an argument it has yet to read.
 static bool spread(int* argCount) {
-  Value args[255];
-  int newArgCount = 0;
+  // the arguments can grow to [UINT8_MAX] in place.
+  reserveStack(UINT8_MAX);
+  Value* args = vm.stackTop - *argCount;
+  Value* values;
+  int count;
 
+  int out = 0;
   for (int i = 0; i < *argCount; i++) {
-    Value arg = vmPop();
+    if (!spreadValues(args[i], &values, &count)) return false;
 
-    if (IS_SPREAD(arg)) {
-      Value vSeq;
-      if (!vmSequenceValueField(AS_INSTANCE(AS_SPREAD(arg)->value), &vSeq))
-        return false;
+    if (count == 0) continue;
+    if (count == 1 && IS_SPREAD(args[i])) args[i] = values[0];
+    args[out++] = args[i];
+  }
 
-      ObjSequence* seq = AS_SEQUENCE(vSeq);
-      for (int j = seq->values.count - 1; j >= 0; j--) {
-        args[newArgCount++] = seq->values.values[j];
-      }
-    } else {
-      args[newArgCount++] = arg;
-    }
+  int total = 0;
+  for (int i = 0; i < out; i++) {
+    if (!spreadValues(args[i], &values, &count)) return false;
+    total += count;
+  }
+
+  if (total > UINT8_MAX) {
+    vmRuntimeError("Can't have more than 255 arguments.");
+    return false;
   }
 
-  *argCount = newArgCount;
-  while (newArgCount > 0) vmPush(args[--newArgCount]);
+  int end = total;
+  for (int i = out - 1; i >= 0; i--) {
+    if (!spreadValues(args[i], &values, &count)) return false;
 
+    if (IS_SPREAD(args[i]))
+      memcpy(args + end - count, values, count * sizeof(Value));
+    else
+      args[end - 1] = args[i];
+    end -= count;
+  }
+
+  vm.stackTop = args + total;
+  *argCount = total;
   return true;
 }
 
+// Push a sequence holding the [count] [values], set up as its
+// initializer would, without pushing the values one by one.
+void vmPushSequence(Value* values, int count) {
+  ObjInstance* instance = newInstance(vm.core.sequence);
+  vmPush(OBJ_VAL(instance));
+  instanceSet(instance, OBJ_VAL(intern(S_CLASS)),
+              OBJ_VAL(vm.core.sequence));
+
+  ObjSequence* seq = newSequence();
+  vmPush(OBJ_VAL(seq));
+  instanceSet(instance, OBJ_VAL(vm.core.sValues), OBJ_VAL(seq));
+
+  if (count > 0) {
+    Value* copy = GROW_ARRAY(Value, NULL, 0, count);
+    memcpy(copy, values, count * sizeof(Value));
+    seq->values.values = copy;
+    seq->values.capacity = count;
+    seq->values.count = count;
+    // growing may have collected and promoted the sequence.
+    for (int i = 0; i < count; i++) writeBarrier((Obj*)seq, copy[i]);
+  }
+  vmPop();  // the raw sequence.
+}
+
 // Collapse [argCount] - [arity] + 1 arguments into a final
-// [Sequence] argument.
+// [Sequence] argument, built directly around a single array
+// sized to the arguments rather than pushed to one at a time.
 static bool variadify(ObjClosure* closure, int* argCount) {
-  // put a sequence on the stack.
-  vmPush(OBJ_VAL(newInstance(vm.core.sequence)));
-  vmInstantiateClass(vm.core.sequence, 0);
-
   // either the function was called (a) with arity - 1 arguments
   // or (b) with arity - n arguments for n > 1. (a) is valid;
   // *args is just an empty sequence. (b) is invalid and will be
   // picked up by the arity check downstream.
-  if (*argCount < closure->function->arity) {
-    *argCount = *argCount + 1;
-    return true;
-  }
+  int count = *argCount - closure->function->arity + 1;
+  if (count < 0) count = 0;
 
-  // walk the variadic arguments in the order they were
-  // applied, peeking at and adding each to the sequence.
-  int i = *argCount - closure->function->arity;
-  while (i >= 0) {
-    Value seq = vmPop();
-    Value arg = vmPeek(i);
+  Value* args = vm.stackTop - count;
+  vmPushSequence(args, count);
 
-    vmPush(seq);
-    vmPush(arg);
+  // leave the sequence on the stack in place of the arguments.
+  args[0] = vmPeek(0);
+  vm.stackTop = args + 1;
+  *argCount = *argCount - count + 1;
 
-    if (!vmInvoke(intern(S_PUSH), 1)) return false;
-    i--;
+  return true;
+}
+
+// Make room for another frame, adding a segment to the frame
+// stack and growing the value stack to fit the frame's [code].
+// Outside of loops, which leave the stack as they found it, the
+// code can push no more values than it has bytes; the natives
+// and spreads it calls push their own into [STACK_FRAME] more.
+static bool reserveFrame(Chunk* code) {
+  if (vm.frameCount == vm.framesMax) {
+    vmRuntimeError("Stack overflow.");
+    return false;
   }
 
-  // now pop the sequence, all the variadic arguments,
-  // and leave the sequence on the stack in their place.
-  Value seq = vmPop();
-  i = *argCount - closure->function->arity;
-  while (i >= 0) {
-    vmPop();
-    i--;
+  if (vm.frameCount == vm.frameSegments * FRAMES_SEGMENT) {
+    vm.frames = (CallFrame**)realloc(
+        vm.frames, sizeof(CallFrame*) * (vm.frameSegments + 1));
+    if (vm.frames == NULL) exit(1);
+
+    CallFrame* segment = (CallFrame*)malloc(sizeof(CallFrame) * FRAMES_SEGMENT);
+    if (segment == NULL) exit(1);
+    vm.frames[vm.frameSegments++] = segment;
   }
-  vmPush(seq);
 
-  // what we've done is made these two equal.
-  *argCount = closure->function->arity;
+  if (vm.stackTop - vm.stack + STACK_FRAME > vm.framesMax * UINT8_COUNT) {
+    vmRuntimeError("Stack overflow.");
+    return false;
+  }
 
+  reserveStack(code->count + STACK_FRAME);
   return true;
 }
 
-void vmInitFrame(ObjClosure* closure, int offset) {
-  CallFrame* frame = &vm.frames[vm.frameCount++];
+bool vmInitFrame(ObjClosure* closure, int offset) {
+  if (!reserveFrame(&closure->function->chunk)) return false;
+
+  CallFrame* frame = vmFrame(vm.frameCount++);
   frame->closure = closure;
   frame->ip = closure->function->chunk.code;
   frame->slots = vm.stackTop - offset;
+  frame->type = FRAME_CALL;
+  frame->enclosing = NULL;
+  return true;
 }
 
 static bool callClosure(ObjClosure* closure, int argCount) {
-  if (!spread(&argCount)) return false;
-
   if (closure->function->variadic)
     if (!variadify(closure, &argCount)) return false;
 
   if (!checkArity(closure->function->name, closure->function->arity, argCount))
     return false;
 
-  if (vm.frameCount == FRAMES_MAX) {
-    vmRuntimeError("Stack overflow.");
-    return false;
-  }
-
-  vmInitFrame(closure, argCount + 1);
-
-  return true;
+  return vmInitFrame(closure, argCount + 1);
 }
 
 static bool callModule(ObjModule* module) {
-  if (vm.frameCount == FRAMES_MAX) {
-    vmRuntimeError("Stack overflow.");
-    return false;
-  }
-
-  vmInitFrame(module->closure, 1);
-
-  return true;
+  return vmInitFrame(module->closure, 1);
 }
 
 static bool callNative(ObjNative* native, int argCount) {
-  if (!spread(&argCount)) return false;
-
   if (!native->variadic && !checkArity(native->name, native->arity, argCount))
     return false;
 
-  return (native->function)(argCount, vm.stackTop - argCount);
+  return (native->function)(argCount);
 }
 
 // Wrap the top [count] values in a sequence and put it
@@ -461,36 +621,253 @@ bool unify(ObjClosure* closure, Value value) {
   vmPush(OBJ_VAL(closure));
   vmPush(value);
 
-  return vmCallValue(unifyFn, 2) &&
-         vmExecute(vm.frameCount - 1) == INTERPRET_OK;
+  return callAndExecute(unifyFn, 2);
 }
 
-static bool callCases(ObjClosure** cases, int caseCount, int argCount) {
-  if (!vmTuplify(argCount, false)) return false;
+// Take the descriptor of the argument [value] that decides which
+// case it selects, given whether some case may match it as a
+// [literal], and whether some case's literal at its position is
+// [opaque]: an expression that may not be a constant. Returns
+// false if the case could depend on more than the descriptor.
+static bool describeArgument(Value value, bool literal, bool opaque,
+                             uint8_t* kind, Value* type) {
+  // annotations override an object's type.
+  if (IS_ANNOTATED(value)) return false;
+
+  if (IS_INSTANCE(value)) {
+    ObjInstance* instance = AS_INSTANCE(value);
+
+    // sets are typed by their elements, not their class.
+    if (isSubclass(instance->klass, vm.core.set)) return false;
+
+    // matching an opaque literal may call the instance's equality.
+    if (opaque && !IS_UNDEF(instance->klass->protocol[PROTOCOL_EQ]))
+      return false;
+
+    if (opaque || vm.dispatchByValue) {
+      *kind = DISPATCH_VALUE;
+      *type = value;
+    } else {
+      *kind = DISPATCH_CLASS;
+      *type = OBJ_VAL(instance->klass);
+    }
+    return true;
+  }
+
+  // functions, classes, and the like are typed by what they are.
+  if (IS_OBJ(value) && !IS_STRING(value)) {
+    *kind = DISPATCH_VALUE;
+    *type = value;
+    return true;
+  }
 
-  Value scrutinee = vmPeek(0);
+  if (literal || vm.dispatchByValue) {
+    *kind = DISPATCH_VALUE;
+    *type = value;
+  } else {
+    *kind = DISPATCH_TYPE;
+    *type = NUMBER_VAL(VALUE_TYPE(value));
+  }
+  return true;
+}
 
+// Does [value] equal a constant literal of one of [cases]
+// at [position]?
+static bool matchesLiteral(ObjClosure** cases, int caseCount, int position,
+                           Value value) {
   for (int i = 0; i < caseCount; i++) {
-    if (!unify(cases[i], scrutinee)) return false;
+    ObjFunction* function = cases[i]->function;
+    if (position < function->paramCount &&
+        function->params[position].kind == MATCH_CONSTANT &&
+        valuesEqual(function->params[position].operand, value))
+      return true;
+  }
+  return false;
+}
 
-    if (AS_BOOL(vmPop())) {
-      vmPop();  // the tuplified scrutinee.
+static Dispatch* newDispatch(ObjClosure** cases, int caseCount) {
+  Dispatch* dispatch = ALLOCATE(Dispatch, 1);
+  dispatch->epoch = vm.dispatchEpoch;
+  dispatch->patterns = 0;
+  dispatch->opaquePatterns = 0;
+  dispatch->count = 0;
+  dispatch->next = 0;
 
-      vm.stackTop[-1 - argCount] = OBJ_VAL(cases[i]);
+  for (int i = 0; i < caseCount; i++) {
+    ObjFunction* function = cases[i]->function;
 
-      return callClosure(cases[i], argCount);
+    for (int j = 0; j < function->paramCount && j < DISPATCH_ARGS_MAX; j++) {
+      MatchKind kind = function->params[j].kind;
+      if (kind == MATCH_CONSTANT || kind == MATCH_LITERAL)
+        dispatch->patterns |= 1u << j;
+      if (kind == MATCH_LITERAL) dispatch->opaquePatterns |= 1u << j;
     }
   }
+  return dispatch;
+}
+
+// Describe the [argCount] arguments on top of the stack in [key],
+// allocating the cache on first use. Returns false if the call
+// can't be cached.
+static bool dispatchKey(Dispatch** cache, ObjClosure** cases, int caseCount,
+                        int argCount, DispatchKey* key) {
+  if (argCount > DISPATCH_ARGS_MAX) return false;
+
+  if (*cache == NULL) *cache = newDispatch(cases, caseCount);
+  Dispatch* dispatch = *cache;
+
+  if (dispatch->epoch != vm.dispatchEpoch) {
+    dispatch->epoch = vm.dispatchEpoch;
+    dispatch->count = 0;
+    dispatch->next = 0;
+  }
+
+  key->argCount = argCount;
+  for (int i = 0; i < argCount; i++) {
+    Value value = vmPeek(argCount - i - 1);
+    bool opaque = dispatch->opaquePatterns & (1u << i);
+    bool literal = opaque || ((dispatch->patterns & (1u << i)) &&
+                              matchesLiteral(cases, caseCount, i, value));
+
+    if (!describeArgument(value, literal, opaque, &key->kinds[i],
+                          &key->types[i]))
+      return false;
+  }
+  return true;
+}
+
+static bool sameDescriptor(Value a, Value b) {
+  if (IS_OBJ(a) || IS_OBJ(b))
+    return IS_OBJ(a) && IS_OBJ(b) && AS_OBJ(a) == AS_OBJ(b);
+  return valuesEqual(a, b);
+}
+
+static bool sameKey(DispatchKey* a, DispatchKey* b) {
+  if (a->argCount != b->argCount) return false;
+
+  for (int i = 0; i < a->argCount; i++)
+    if (a->kinds[i] != b->kinds[i] || !sameDescriptor(a->types[i], b->types[i]))
+      return false;
+  return true;
+}
+
+#define DISPATCH_MISS -2
+
+// The case cached for [key], -1 if none matched it, or DISPATCH_MISS.
+static int lookupDispatch(Dispatch* dispatch, DispatchKey* key) {
+  for (int i = 0; i < dispatch->count; i++)
+    if (sameKey(&dispatch->entries[i].key, key))
+      return dispatch->entries[i].match;
+  return DISPATCH_MISS;
+}
+
+static void storeDispatch(Dispatch* dispatch, DispatchKey* key, int match) {
+  int slot;
+  if (dispatch->count < DISPATCH_ENTRIES) {
+    slot = dispatch->count++;
+  } else {
+    slot = dispatch->next;
+    dispatch->next = (dispatch->next + 1) % DISPATCH_ENTRIES;
+  }
+
+  dispatch->entries[slot].key = *key;
+  dispatch->entries[slot].match = match;
+}
+
+// Match the [argCount] arguments at [args] against the signature
+// of [function] without the type solver, putting the result in
+// [matched]. Returns false if only the solver can tell.
+static bool matchSignature(ObjFunction* function, int argCount, Value* args,
+                           bool* matched) {
+  if (function->paramCount != function->arity) return false;
 
-  // no match: replace the arguments and the case object with undef.
-  vmPop();                     // tuplified scrutinee.
-  while (argCount--) vmPop();  // args.
-  vmPop();                     // case.
-  vmPush(UNDEF_VAL);
+  *matched = false;
+  if (argCount != function->arity) return true;
 
+  for (int i = 0; i < argCount; i++) {
+    ParamMatch* param = &function->params[i];
+    Value arg = args[i];
+
+    switch (param->kind) {
+      case MATCH_ANY:
+        break;
+      case MATCH_CONSTANT:
+        if (!valuesEqual(param->operand, arg)) return true;
+        break;
+      case MATCH_CLASS: {
+        Value klass;
+        if (!mapGet(&vm.module->namespace, param->operand, &klass) &&
+            !mapGet(&vm.globals, param->operand, &klass))
+          return false;
+
+        // domains and collections have types of their own.
+        if (!IS_CLASS(klass) || vm.dispatchByValue) return false;
+        if (IS_OBJ(arg) && !IS_INSTANCE(arg) && !IS_STRING(arg)) return false;
+        if (IS_ANNOTATED(arg)) return false;
+
+        if (!IS_INSTANCE(arg)) return true;
+        if (isSubclass(AS_INSTANCE(arg)->klass, vm.core.set)) return false;
+        if (!isSubclass(AS_INSTANCE(arg)->klass, AS_CLASS(klass))) return true;
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+
+  *matched = true;
   return true;
 }
 
+// Call the first of [cases] whose signature unifies with the
+// arguments, or replace the call with undef if none does. Which
+// case the arguments select is cached by their types.
+static bool callCases(Obj* owner, Dispatch** cache, ObjClosure** cases,
+                      int caseCount, int argCount) {
+  DispatchKey key;
+  bool cacheable = dispatchKey(cache, cases, caseCount, argCount, &key);
+  int match = cacheable ? lookupDispatch(*cache, &key) : DISPATCH_MISS;
+
+  if (match == DISPATCH_MISS) {
+    int epoch = vm.dispatchEpoch;
+    bool tuplified = false;
+
+    match = -1;
+    for (int i = 0; i < caseCount && match == -1; i++) {
+      Value* args = vm.stackTop - argCount - tuplified;
+      bool matched;
+
+      // simple signatures match natively, and the rest by
+      // unifying them with the tuplified arguments.
+      if (!matchSignature(cases[i]->function, argCount, args, &matched)) {
+        if (!tuplified && !vmTuplify(argCount, false)) return false;
+        tuplified = true;
+
+        if (!unify(cases[i], vmPeek(0))) return false;
+        matched = AS_BOOL(vmPop());
+      }
+
+      if (matched) match = i;
+    }
+    if (tuplified) vmPop();  // the tuplified scrutinee.
+
+    if (cacheable && epoch == vm.dispatchEpoch) {
+      storeDispatch(*cache, &key, match);
+      for (int i = 0; i < key.argCount; i++) writeBarrier(owner, key.types[i]);
+    }
+  }
+
+  if (match == -1) {
+    // no match: replace the arguments and the case object with undef.
+    vm.stackTop -= argCount + 1;
+    vmPush(UNDEF_VAL);
+    return true;
+  }
+
+  vm.stackTop[-1 - argCount] = OBJ_VAL(cases[match]);
+  return callClosure(cases[match], argCount);
+}
+
 bool vmCallValue(Value caller, int argCount) {
   if (IS_OBJ(caller)) {
     switch (OBJ_TYPE(caller)) {
@@ -516,19 +893,21 @@ bool vmCallValue(Value caller, int argCount) {
         ObjClosure* closure = AS_CLOSURE(caller);
 
         if (closure->function->patterned)
-          return callCases(&closure, 1, argCount);
+          return callCases((Obj*)closure, &closure->dispatch, &closure, 1,
+                           argCount);
         return callClosure(AS_CLOSURE(caller), argCount);
       }
       case OBJ_OVERLOAD: {
         ObjOverload* overload = AS_OVERLOAD(caller);
-        return callCases(overload->closures, overload->cases, argCount);
+        return callCases((Obj*)overload, &overload->dispatch,
+                         overload->closures, overload->cases, argCount);
       }
       case OBJ_NATIVE:
         return callNative(AS_NATIVE(caller), argCount);
       case OBJ_INSTANCE: {
         ObjInstance* instance = AS_INSTANCE(caller);
-        Value callFn;
-        if (mapGet(&instance->klass->fields, INTERN(S_CALL), &callFn)) {
+        Value callFn = instance->klass->protocol[PROTOCOL_CALL];
+        if (!IS_UNDEF(callFn)) {
           return callClosure(AS_CLOSURE(callFn), argCount);
         } else {
           vmRuntimeError("Objects require a '%s' method to be called.", S_CALL);
@@ -556,7 +935,8 @@ static void bindClosure(Value receiver, Value* value) {
   }
 }
 
-ObjUpvalue* vmCaptureUpvalue(Value* local, uint8_t slot, ObjString* name) {
+ObjUpvalue* vmCaptureUpvalue(Value* local, uint8_t slot, int offset,
+                             ObjFunction* function) {
   ObjUpvalue* prevUpvalue = NULL;
   ObjUpvalue* upvalue = vm.openUpvalues;
   while (upvalue != NULL && upvalue->location > local) {
@@ -568,7 +948,7 @@ ObjUpvalue* vmCaptureUpvalue(Value* local, uint8_t slot, ObjString* name) {
     return upvalue;
   }
 
-  ObjUpvalue* createdUpvalue = newUpvalue(local, slot, name);
+  ObjUpvalue* createdUpvalue = newUpvalue(local, slot, offset, function);
   createdUpvalue->next = upvalue;
 
   if (prevUpvalue == NULL) {
@@ -585,15 +965,15 @@ void vmCaptureUpvalues(ObjClosure* closure, CallFrame* frame) {
     uint8_t isLocal = READ_BYTE();
     uint8_t index = READ_BYTE();
     if (isLocal) {
-      Token token = frame->closure->function->locals[index].name;
-      ObjString* name = copyString(token.start, token.length);
-      vmPush(OBJ_VAL(name));
+      ObjFunction* function = frame->closure->function;
+      int offset = frame->ip - function->chunk.code - 1;
       closure->upvalues[i] =
-          vmCaptureUpvalue(frame->slots + index, index, name);
-      vmPop();
+          vmCaptureUpvalue(frame->slots + index, index, offset, function);
     } else {
       closure->upvalues[i] = frame->closure->upvalues[index];
     }
+    // capturing may have collected and promoted the closure.
+    writeBarrier((Obj*)closure, OBJ_VAL(closure->upvalues[i]));
   }
 }
 
@@ -602,6 +982,7 @@ void vmCloseUpvalues(Value* last) {
     ObjUpvalue* upvalue = vm.openUpvalues;
     upvalue->closed = *upvalue->location;
     upvalue->location = &upvalue->closed;
+    writeBarrier((Obj*)upvalue, upvalue->closed);
     vm.openUpvalues = upvalue->next;
   }
 }
@@ -618,14 +999,6 @@ void vmClosure(CallFrame* frame) {
 
   vmPush(OBJ_VAL(closure));
   vmCaptureUpvalues(closure, frame);
-
-  mapSet(&function->fields, OBJ_VAL(vm.core.sName), OBJ_VAL(function->name));
-  mapSet(&function->fields, OBJ_VAL(vm.core.sArity),
-         NUMBER_VAL(function->arity));
-  mapSet(&function->fields, OBJ_VAL(vm.core.sPatterned),
-         BOOL_VAL(function->patterned));
-  mapSet(&function->fields, OBJ_VAL(vm.core.sVariadic),
-         BOOL_VAL(function->variadic));
 }
 
 void vmSign(CallFrame* frame) {
@@ -690,927 +1063,1632 @@ bool vmImport(ObjModule* module, ObjMap* target) {
   return true;
 }
 
-bool vmImportAsInstance(ObjModule* module) {
-  vmPush(OBJ_VAL(vm.core.module));
-  if (!vmInitInstance(vm.core.module, 0)) return false;
-  ObjInstance* objModule = AS_INSTANCE(vmPeek(0));
+// The namespace that the current module's imports merge into.
+static ObjMap* importTarget() {
+  return vm.module->type == MODULE_ENTRYPOINT ? &vm.globals
+                                              : &vm.module->namespace;
+}
 
-  if (!vmImport(module, &objModule->fields)) return false;
+// Push a frame for [module] that the dispatch loop runs
+// in place, concluding the import when the frame returns.
+static bool beginImport(ObjModule* module) {
+  vmPush(OBJ_VAL(module));
+  if (!callModule(module)) return false;
+
+  CallFrame* frame = vmFrame(vm.frameCount - 1);
+  frame->type = FRAME_IMPORT;
+  frame->enclosing = vm.module;
+  vm.module = module;
+  return true;
+}
+
+// Does [klass] have the same [protocol] method as [core]?
+static bool inheritsMethod(ObjClass* klass, ObjClass* core,
+                           Protocol protocol) {
+  Value method = klass->protocol[protocol];
+  Value coreMethod = core->protocol[protocol];
+  return IS_OBJ(method) && IS_OBJ(coreMethod) &&
+         AS_OBJ(method) == AS_OBJ(coreMethod);
+}
+
+// Add [element] to the comprehension [comp] directly if it's a
+// sequence or set that builds itself the way the core classes do,
+// setting [added]. Otherwise it's left to the class's own add.
+static bool comprehensionAdd(Obj* comp, Value element, bool* added) {
+  *added = false;
+  if (comp->oType != OBJ_INSTANCE) return true;
 
-  mapSet(&objModule->fields, OBJ_VAL(vm.core.sModule), OBJ_VAL(module));
+  ObjInstance* instance = (ObjInstance*)comp;
+  ObjClass* klass = instance->klass;
 
+  if (inheritsMethod(klass, vm.core.sequence, PROTOCOL_ADD)) {
+    Value seq;
+    if (!vmSequenceValueField(instance, &seq)) return false;
+
+    writeValueArray(&AS_SEQUENCE(seq)->values, element);
+    writeBarrier(AS_OBJ(seq), element);
+    *added = true;
+    return true;
+  }
+
+  if (inheritsMethod(klass, vm.core.set, PROTOCOL_ADD) &&
+      inheritsMethod(klass, vm.core.set, PROTOCOL_SET)) {
+    Value inner;
+    if (!instanceGet(instance, OBJ_VAL(vm.core.sInner), &inner) ||
+        !IS_INSTANCE(inner) ||
+        !IS_UNDEF(AS_INSTANCE(inner)->klass->protocol[PROTOCOL_SET]))
+      return true;
+
+    uint32_t hash;
+    if (!vmHashValue(element, &hash)) return false;
+
+    mapSetHash(instanceFields(AS_INSTANCE(inner)), element, BOOL_VAL(true),
+               hash);
+    *added = true;
+  }
   return true;
 }
 
+static void endImport(CallFrame* frame) {
+  ObjModule* module = vm.module;
+  vm.module = frame->enclosing;
+
+  vmPush(OBJ_VAL(module));
+  mapAddAll(&module->namespace, importTarget());
+  vmPop();
+}
+
 static bool isFalsey(Value value) {
   return IS_NIL(value) || IS_UNDEF(value) ||
          (IS_BOOL(value) && !AS_BOOL(value));
 }
 
-static bool assertInt(Value value, char* msg) {
-  if (!IS_INTEGER(value)) {
-    vmRuntimeError(msg);
-    return false;
-  }
+// Whether annotations [a] and [b] are the same type, by the
+// equality their classes define, in [equal].
+static bool sameAnnotation(Value a, Value b, bool* equal) {
+  *equal = valuesEqual(a, b);
+  if (*equal || !IS_INSTANCE(a) || !IS_INSTANCE(b)) return true;
+
+  ObjClass* lca =
+      leastCommonAncestor(AS_INSTANCE(a)->klass, AS_INSTANCE(b)->klass);
+  if (lca == NULL || IS_UNDEF(lca->protocol[PROTOCOL_EQ])) return true;
+
+  vmPush(b);
+  vmPush(a);
+  if (!callAndExecute(lca->protocol[PROTOCOL_EQ], 1)) return false;
+  *equal = !isFalsey(vmPop());
   return true;
 }
 
-static bool validateStrIdx(ObjString* str, Value idx) {
-  if (!assertInt(idx, "Strings must be indexed by integer.")) return false;
-  int intIdx = AS_NUMBER(idx);
-  if (intIdx > str->length - 1 || intIdx < 0) {
-    vmRuntimeError("Index %i out of bounds for string of length %i.", intIdx,
-                   str->length);
-    return false;
-  }
+// Annotate the result of a call with the type
+// that was instantiated for it beneath the callee.
+static bool annotateResult() {
+  Value result = vmPeek(0);
+  Value annotation = vmPeek(1);
+
+  // a result that's returned again keeps a single copy. cached
+  // instantiations share the copy, and the rest are compared by
+  // their type's equality.
+  if (IS_OBJ(result)) {
+    Obj* object = AS_OBJ(result);
+    bool found = annotationCount(object) > 0 &&
+                 findInValueArray(objectAnnotations(object), annotation);
+
+    // the comparison may annotate the result, so look it up each time.
+    for (int i = 0; !found && i < annotationCount(object); i++) {
+      Value other = objectAnnotations(object)->values[i];
+      if (!sameAnnotation(other, annotation, &found)) return false;
+    }
 
+    if (!found) annotateObject(object, annotation);
+  }
+  vmPop();
+  vmPop();
+  vmPush(result);
   return true;
 }
 
-static bool validateSeqIdx(ObjSequence* seq, Value idx) {
-  if (!assertInt(idx, "Sequences must be indexed by integer.")) return false;
-  int intIdx = AS_NUMBER(idx);
+// Call the infix [name] sitting between its operands,
+// preferring a method on the operands' common ancestor.
+static bool callInfix(Value name) {
+  Value right = vmPeek(0);
+  Value infix = vmPeek(1);
+  Value left = vmPeek(2);
+
+  if (IS_INSTANCE(left) && IS_INSTANCE(right)) {
+    ObjClass* lca = leastCommonAncestor(AS_INSTANCE(left)->klass,
+                                        AS_INSTANCE(right)->klass);
+    if (lca != NULL) {
+      Value method;
+      if (mapGet(&lca->fields, name, &method)) {
+        vmPop();
+        vmPop();
+        vmPush(right);
+        return vmCallValue(method, 1);
+      }
+    }
+  }
 
-  if (intIdx > seq->values.count - 1 || intIdx < 0) {
-    vmRuntimeError("Index %i out of bounds for sequence of length %i.", intIdx,
-                   seq->values.count);
+  if (IS_UNDEF(infix)) {
+    vmRuntimeError("Undefined variable '%s'.", AS_STRING(name)->chars);
     return false;
   }
 
-  return true;
+  vmPop();
+  vmPop();
+  vmPop();
+
+  vmPush(infix);
+  vmPush(left);
+  vmPush(right);
+
+  return vmCallValue(infix, 2);
 }
 
-bool vmSequenceValueField(ObjInstance* obj, Value* seq) {
-  if (!mapGet(&obj->fields, OBJ_VAL(vm.core.sValues), seq)) {
-    vmRuntimeError("Sequence instance missing its values!");
-    return false;
-  }
-  if (!IS_SEQUENCE(*seq)) {
-    vmRuntimeError("Expecting sequence.");
-    return false;
+// Is [name] one of the operators with a dedicated instruction?
+static bool isNativeOperator(Value name) {
+  ObjString* string = AS_STRING(name);
+
+  switch (string->length) {
+    case 1:
+      return strchr("+-*/<>", string->chars[0]) != NULL;
+    case 2:
+      return strchr("<>", string->chars[0]) != NULL &&
+             string->chars[1] == '=';
+    default:
+      return false;
   }
-  return true;
 }
 
-static bool vmInstanceHas(ObjInstance* instance, Value value) {
-  uint32_t hash;
-  if (!vmHashValue(value, &hash)) return false;
+// The inline cache for [chunk]'s [constant].
+static InlineCache* inlineCache(Chunk* chunk, uint16_t constant) {
+  if (chunk->cacheCount <= constant) {
+    int oldCount = chunk->cacheCount;
+    chunk->caches = GROW_ARRAY(InlineCache, chunk->caches, oldCount,
+                               chunk->constants.count);
+    chunk->cacheCount = chunk->constants.count;
+
+    for (int i = oldCount; i < chunk->cacheCount; i++) {
+      chunk->caches[i].module = NULL;
+      chunk->caches[i].shapeId = 0;
+      chunk->caches[i].klass = NULL;
+    }
+  }
 
-  bool hasKey = mapHasHash(&instance->fields, value, hash) ||
-                mapHasHash(&instance->klass->fields, value, hash);
-  vmPush(BOOL_VAL(hasKey));
-  return true;
+  return &chunk->caches[constant];
 }
 
-// Loop until we're back to [baseFrame] frames. Typically this
-// is just 0, but if we want to execute a single function in the
-// middle of execution we can let [baseFrame] = the current frame.
-InterpretResult vmExecute(int baseFrame) {
-  CallFrame* frame = &vm.frames[vm.frameCount - 1];
+// Does [map] hold the key [name] at [index]?
+static inline MapEntry* entryAt(ObjMap* map, int index, Value name) {
+  if (index >= map->capacity) return NULL;
 
-  for (;;) {
-    if (vm.frameCount == baseFrame) return INTERPRET_OK;
+  MapEntry* entry = &map->entries[index];
+  if (IS_OBJ(entry->key) && AS_OBJ(entry->key) == AS_OBJ(name)) return entry;
+  return NULL;
+}
 
-    TRACE_EXECUTION("");
+// Find the global named by [chunk]'s [constant], first in the
+// current module's namespace and then in the globals. Where it
+// was found is cached and trusted for as long as the same
+// module is executing, its namespace hasn't grown, and the
+// entry at the cached index still holds the name.
+static MapEntry* globalEntry(Chunk* chunk, uint16_t constant) {
+  Value name = chunk->constants.values[constant];
+  ObjMap* namespace = &vm.module->namespace;
+  InlineCache* cache = inlineCache(chunk, constant);
+
+  if (cache->module == vm.module &&
+      cache->namespaceCount == namespace->count) {
+    ObjMap* map = cache->inNamespace ? namespace : &vm.globals;
+    MapEntry* entry = entryAt(map, cache->globalIndex, name);
+    if (entry != NULL) return entry;
+  }
 
-    uint8_t instruction;
+  ObjMap* map = namespace;
+  MapEntry* entry = mapGetEntry(map, name);
+  if (entry == NULL) {
+    map = &vm.globals;
+    entry = mapGetEntry(map, name);
+  }
+  if (entry == NULL) return NULL;
 
-    switch (instruction = READ_BYTE()) {
-      case OP_UNDEFINED:
-        vmPush(UNDEF_VAL);
-        break;
-      case OP_CONSTANT: {
-        Value constant = READ_CONSTANT();
-        vmPush(constant);
-        break;
-      }
-      case OP_NIL:
-        vmPush(NIL_VAL);
-        break;
-      case OP_TRUE:
-        vmPush(BOOL_VAL(true));
-        break;
-      case OP_FALSE:
-        vmPush(BOOL_VAL(false));
-        break;
-      case OP_EXPR_STATEMENT:
-      case OP_POP:
-        vmPop();
-        break;
-      case OP_GET_LOCAL: {
-        uint8_t slot = READ_SHORT();
-        vmPush(frame->slots[slot]);
-        break;
-      }
-      case OP_SET_LOCAL: {
-        uint8_t slot = READ_SHORT();
-        frame->slots[slot] = vmPeek(0);
-        break;
-      }
-      case OP_GET_GLOBAL: {
-        ObjString* name = READ_STRING();
+  cache->module = vm.module;
+  cache->namespaceCount = namespace->count;
+  cache->inNamespace = map == namespace;
+  cache->globalIndex = (int)(entry - map->entries);
 
-        Value value;
-        if (!mapGet(&vm.module->namespace, OBJ_VAL(name), &value) &&
-            !mapGet(&vm.globals, OBJ_VAL(name), &value)) {
-          vmRuntimeError("Undefined variable '%s'.", name->chars);
-          return INTERPRET_RUNTIME_ERROR;
-        }
+  return entry;
+}
 
-        vmPush(value);
-        break;
+// Find the method named by [chunk]'s [constant] in [klass]'s
+// fields, trusting the cached index while the receiver's class
+// is the same and the entry there still holds the name.
+static MapEntry* methodEntry(Chunk* chunk, uint16_t constant,
+                             ObjClass* klass) {
+  Value name = chunk->constants.values[constant];
+  InlineCache* cache = inlineCache(chunk, constant);
+
+  if (cache->klass == klass) {
+    MapEntry* entry = entryAt(&klass->fields, cache->methodIndex, name);
+    if (entry != NULL) return entry;
+  }
+
+  MapEntry* entry = mapGetEntry(&klass->fields, name);
+  if (entry == NULL) return NULL;
+
+  cache->klass = klass;
+  cache->methodIndex = (int)(entry - klass->fields.entries);
+
+  return entry;
+}
+
+// Find the field of [instance] named by [chunk]'s [constant].
+// Shapes are never reused, so a slot cached for the instance's
+// shape can be trusted outright.
+static bool fieldValue(Chunk* chunk, uint16_t constant, ObjInstance* instance,
+                       Value* value) {
+  Value name = chunk->constants.values[constant];
+  if (instance->shape == NULL) return mapGet(&instance->fields, name, value);
+
+  InlineCache* cache = inlineCache(chunk, constant);
+  if (cache->shapeId != instance->shape->id) {
+    cache->shapeId = instance->shape->id;
+    cache->fieldSlot = shapeSlot(instance->shape, AS_STRING(name));
+  }
+
+  if (cache->fieldSlot == -1) return false;
+  *value = instance->slots[cache->fieldSlot];
+  return true;
+}
+
+// Set the field of [instance] named by [chunk]'s [constant],
+// writing straight to its slot when the instance already has it.
+static void setField(Chunk* chunk, uint16_t constant, ObjInstance* instance,
+                     Value value) {
+  Value field;
+  if (instance->shape != NULL &&
+      fieldValue(chunk, constant, instance, &field)) {
+    instance->slots[inlineCache(chunk, constant)->fieldSlot] = value;
+    writeBarrier((Obj*)instance, value);
+    return;
+  }
+
+  instanceSet(instance, chunk->constants.values[constant], value);
+}
+
+// Read a global's constant from [frame] and find its entry.
+static MapEntry* readGlobal(CallFrame* frame) {
+  Chunk* chunk = &frame->closure->function->chunk;
+  uint16_t constant = READ_SHORT();
+
+  MapEntry* entry = globalEntry(chunk, constant);
+  if (entry == NULL)
+    vmRuntimeError("Undefined variable '%s'.",
+                   AS_STRING(chunk->constants.values[constant])->chars);
+
+  return entry;
+}
+
+// Slot the global operator read from [frame] between
+// its operands and call it like any other infix.
+static bool callOperator(CallFrame* frame) {
+  Chunk* chunk = &frame->closure->function->chunk;
+  uint16_t constant = READ_SHORT();
+
+  MapEntry* entry = globalEntry(chunk, constant);
+  Value infix = entry == NULL ? UNDEF_VAL : entry->value;
+
+  Value right = vmPop();
+  vmPush(infix);
+  vmPush(right);
+
+  return callInfix(chunk->constants.values[constant]);
+}
+
+// Replace the receiver on top of the stack with its
+// property named by [chunk]'s [constant].
+static bool getProperty(Chunk* chunk, uint16_t constant) {
+  Value name = chunk->constants.values[constant];
+  Value value = NIL_VAL;
+
+  char* error = "Can only get property of object, class, or function.";
+
+  if (!IS_OBJ(vmPeek(0))) {
+    vmRuntimeError(error);
+    return false;
+  }
+
+  switch (OBJ_TYPE(vmPeek(0))) {
+    case OBJ_INSTANCE: {
+      ObjInstance* instance = AS_INSTANCE(vmPeek(0));
+
+      if (!fieldValue(chunk, constant, instance, &value)) {
+        // class prop. must be a method.
+        MapEntry* method = methodEntry(chunk, constant, instance->klass);
+        if (method != NULL) {
+          value = method->value;
+          bindClosure(vmPeek(0), &value);
+        }
       }
-      case OP_DEFINE_GLOBAL: {
-        Value name = READ_CONSTANT();
-        ObjMap* target = vm.module->type == MODULE_ENTRYPOINT
-                             ? &vm.globals
-                             : &vm.module->namespace;
-        mapSet(target, name, vmPeek(0));
+
+      vmPop();  // instance.
+      vmPush(value);
+      break;
+    }
+    case OBJ_CLASS: {
+      ObjClass* klass = AS_CLASS(vmPeek(0));
+
+      mapGet(&klass->fields, name, &value);
+      bindClosure(vmPeek(0), &value);
+      vmPop();  // class.
+      vmPush(value);
+      break;
+    }
+    case OBJ_VARIABLE: {
+      if (strcmp(AS_STRING(name)->chars, "name") == 0) {
+        value = OBJ_VAL(AS_VARIABLE(vmPeek(0))->name);
         vmPop();
-        break;
       }
-      case OP_SET_GLOBAL: {
-        Value name = READ_CONSTANT();
-        if (mapSet(&vm.module->namespace, name, vmPeek(0))) {
-          mapDelete(&vm.module->namespace, name);
-          if (mapSet(&vm.globals, name, vmPeek(0))) {
-            mapDelete(&vm.globals, name);
-            vmRuntimeError("Undefined variable '%s'.", AS_STRING(name)->chars);
-            return INTERPRET_RUNTIME_ERROR;
-          }
-        }
+
+      vmPush(value);
+      break;
+    }
+    case OBJ_NATIVE: {
+      ObjNative* native = AS_NATIVE(vmPeek(0));
+      mapGet(&native->fields, name, &value);
+
+      vmPop();  // native.
+      vmPush(value);
+      break;
+    }
+    case OBJ_BOUND_FUNCTION: {
+      ObjBoundFunction* obj = AS_BOUND_FUNCTION(vmPop());
+
+      if (obj->type == BOUND_NATIVE) {
+        mapGet(&obj->bound.native->fields, name, &value);
+        vmPush(value);
         break;
       }
-      case OP_GET_PROPERTY: {
-        Value name = READ_CONSTANT();
-        Value value = NIL_VAL;
 
-        char* error = "Can only get property of object, class, or function.";
+      vmPush(OBJ_VAL(obj->bound.method));
+    }
+      __attribute__((fallthrough));
+    case OBJ_CLOSURE: {
+      ObjClosure* closure = AS_CLOSURE(vmPeek(0));
 
-        if (!IS_OBJ(vmPeek(0))) {
-          vmRuntimeError(error);
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      mapGet(&closure->function->fields, name, &value);
 
-        switch (OBJ_TYPE(vmPeek(0))) {
-          case OBJ_INSTANCE: {
-            ObjInstance* instance = AS_INSTANCE(vmPeek(0));
+      vmPop();  // closure.
+      vmPush(value);
+      break;
+    }
+    case OBJ_OVERLOAD: {
+      ObjOverload* overload = AS_OVERLOAD(vmPeek(0));
 
-            if (!mapGet(&instance->fields, name, &value)) {
-              // class prop. must be a method.
-              if (mapGet(&instance->klass->fields, name, &value)) {
-                bindClosure(vmPeek(0), &value);
-              }
-            }
+      mapGet(&overload->fields, name, &value);
 
-            vmPop();  // instance.
-            vmPush(value);
-            break;
-          }
-          case OBJ_CLASS: {
-            ObjClass* klass = AS_CLASS(vmPeek(0));
+      vmPop();  // overload.
+      vmPush(value);
+      break;
+    }
+    default:
+      vmRuntimeError(error);
+      return false;
+  }
 
-            mapGet(&klass->fields, name, &value);
-            bindClosure(vmPeek(0), &value);
-            vmPop();  // class.
-            vmPush(value);
-            break;
-          }
-          case OBJ_VARIABLE: {
-            if (strcmp(AS_STRING(name)->chars, "name") == 0) {
-              value = OBJ_VAL(AS_VARIABLE(vmPeek(0))->name);
-              vmPop();
-            }
+  return true;
+}
 
-            vmPush(value);
-            break;
-          }
-          case OBJ_NATIVE: {
-            ObjNative* native = AS_NATIVE(vmPeek(0));
-            mapGet(&native->fields, name, &value);
+static uint32_t descriptorHash(Value value) {
+  if (IS_OBJ(value)) return (uint32_t)((uintptr_t)AS_OBJ(value) >> 3);
+  return hashValue(value);
+}
 
-            vmPop();  // native.
-            vmPush(value);
-            break;
-          }
-          case OBJ_BOUND_FUNCTION: {
-            ObjBoundFunction* obj = AS_BOUND_FUNCTION(vmPop());
+// The cached instantiation of [callee] for the [argCount] arguments
+// on top of the stack, with their [key] and the entry they belong
+// in. Returns false if the call can't be cached.
+static bool instantiationEntry(Value callee, int argCount, DispatchKey* key,
+                               Instantiation** entry) {
+  if (argCount > DISPATCH_ARGS_MAX) return false;
 
-            if (obj->type == BOUND_NATIVE) {
-              mapGet(&obj->bound.native->fields, name, &value);
-              vmPush(value);
-              break;
-            }
+  uint32_t hash = descriptorHash(callee);
+  key->argCount = argCount;
 
-            vmPush(OBJ_VAL(obj->bound.method));
-          }
-            __attribute__((fallthrough));
-          case OBJ_CLOSURE: {
-            ObjClosure* closure = AS_CLOSURE(vmPeek(0));
+  for (int i = 0; i < argCount; i++) {
+    Value value = vmPeek(argCount - i - 1);
 
-            mapGet(&closure->function->fields, name, &value);
+    if (!describeArgument(value, false, false, &key->kinds[i], &key->types[i]))
+      return false;
 
-            vmPop();  // closure.
-            vmPush(value);
-            break;
-          }
-          case OBJ_OVERLOAD: {
-            ObjOverload* overload = AS_OVERLOAD(vmPeek(0));
+    hash = (hash ^ descriptorHash(key->types[i])) * 16777619u + key->kinds[i];
+  }
 
-            mapGet(&overload->fields, name, &value);
+  *entry = &vm.instantiations[hash & (INSTANTIATIONS - 1)];
+  return true;
+}
 
-            vmPop();  // overload.
-            vmPush(value);
-            break;
-          }
-          default:
-            vmRuntimeError(error);
-            return INTERPRET_RUNTIME_ERROR;
-        }
+static bool sameInstantiation(Instantiation* entry, Value callee,
+                              DispatchKey* key) {
+  return IS_OBJ(entry->callee) && AS_OBJ(entry->callee) == AS_OBJ(callee) &&
+         entry->annotationCount == annotationCount(AS_OBJ(callee)) &&
+         entry->epoch == vm.dispatchEpoch && sameKey(&entry->key, key);
+}
 
-        break;
+// Put the range type of the annotated callee beneath [argCount]
+// arguments on the stack, under the callee.
+static bool instantiate(int argCount) {
+  Value callee = vmPeek(argCount);
+  DispatchKey key;
+  Instantiation* entry = NULL;
+  bool cacheable = instantiationEntry(callee, argCount, &key, &entry);
+
+  if (cacheable && sameInstantiation(entry, callee, &key)) {
+    Value* slot = vm.stackTop - argCount - 1;
+    memmove(slot + 1, slot, sizeof(Value) * (argCount + 1));
+    *slot = entry->type;
+    vm.stackTop++;
+    return true;
+  }
+
+  Value args[UINT8_COUNT];
+  for (int i = argCount; i > 0; i--) args[i - 1] = vmPop();
+  vmPop();  // the callee.
+
+  vmPush(OBJ_VAL(vm.core.typeSystem));
+  vmPush(callee);
+  for (int i = 0; i < argCount; i++) vmPush(args[i]);
+  if (!vmExecuteMethod("instantiate", argCount + 1)) return false;
+
+  // set up the call.
+  vmPush(callee);
+  for (int i = 0; i < argCount; i++) vmPush(args[i]);
+
+  if (cacheable) {
+    entry->callee = callee;
+    entry->annotationCount = annotationCount(AS_OBJ(callee));
+    entry->epoch = vm.dispatchEpoch;
+    entry->key = key;
+    entry->type = vmPeek(argCount + 1);
+  }
+  return true;
+}
+
+// Call the value beneath [argCount] arguments on the stack,
+// first instantiating its type if it's annotated.
+static bool call(int argCount) {
+  Value caller = vmPeek(argCount);
+  bool annotated = IS_ANNOTATED(caller);
+
+  // if the caller has a type annotation then calculate its range.
+  if (annotated && !instantiate(argCount)) return false;
+
+  int frameCount = vm.frameCount;
+  if (!vmCallValue(caller, argCount)) return false;
+
+  // if the call pushed a frame then we annotate its
+  // result when it returns. otherwise it's done already.
+  if (annotated) {
+    if (vm.frameCount > frameCount)
+      vmFrame(vm.frameCount - 1)->type = FRAME_ANNOTATED_CALL;
+    else if (!annotateResult())
+      return false;
+  }
+
+  return true;
+}
+
+// Call the property named by [chunk]'s [constant] on the receiver
+// beneath [argCount] arguments. Methods found on an instance's
+// class are called directly rather than bound first.
+static bool invoke(Chunk* chunk, uint16_t constant, int argCount) {
+  Value receiver = vmPeek(argCount);
+
+  if (IS_INSTANCE(receiver)) {
+    ObjInstance* instance = AS_INSTANCE(receiver);
+    Value value = NIL_VAL;
+
+    if (!fieldValue(chunk, constant, instance, &value)) {
+      MapEntry* method = methodEntry(chunk, constant, instance->klass);
+
+      if (method != NULL) {
+        if (IS_CLOSURE(method->value))
+          return callClosure(AS_CLOSURE(method->value), argCount);
+        if (IS_NATIVE(method->value))
+          return callNative(AS_NATIVE(method->value), argCount);
+        value = method->value;
       }
-      case OP_SET_PROPERTY: {
-        Value name = READ_CONSTANT();
-        ObjMap* fields;
+    }
 
-        char* error = "Can only set property of object, class, or function.";
+    vm.stackTop[-argCount - 1] = value;
+    return call(argCount);
+  }
 
-        if (!IS_OBJ(vmPeek(1))) {
-          vmRuntimeError(error);
-          return INTERPRET_RUNTIME_ERROR;
-        }
+  vmPush(receiver);
+  if (!getProperty(chunk, constant)) return false;
+  vm.stackTop[-argCount - 2] = vmPop();
+  return call(argCount);
+}
 
-        switch (OBJ_TYPE(vmPeek(1))) {
-          case OBJ_INSTANCE:
-            fields = &AS_INSTANCE(vmPeek(1))->fields;
-            break;
-          case OBJ_CLASS:
-            fields = &AS_CLASS(vmPeek(1))->fields;
-            break;
-          case OBJ_BOUND_FUNCTION: {
-            ObjBoundFunction* obj = AS_BOUND_FUNCTION(vmPeek(1));
-            if (obj->type == BOUND_NATIVE) {
-              vmRuntimeError("Can't set property of native.");
-              return INTERPRET_RUNTIME_ERROR;
-            }
-            fields = &obj->bound.method->function->fields;
-            break;
-          }
-          case OBJ_CLOSURE:
-            fields = &AS_CLOSURE(vmPeek(1))->function->fields;
-            break;
-          default:
-            vmRuntimeError(error);
-            return INTERPRET_RUNTIME_ERROR;
-        }
+// Having made a call in tail position from [frame], let the
+// callee take the frame over if the call pushed one and both
+// return the ordinary way: close the caller's upvalues and slide
+// the callee's window down over its slots.
+static void tailCall(CallFrame* frame) {
+  if (vm.frameCount < 2 || vmFrame(vm.frameCount - 2) != frame) return;
 
-        mapSet(fields, name, vmPeek(0));
-        vmPop();
-        break;
+  CallFrame* callee = vmFrame(vm.frameCount - 1);
+  if (frame->type != FRAME_CALL || callee->type != FRAME_CALL) return;
+
+  vmCloseUpvalues(frame->slots);
+
+  int count = vm.stackTop - callee->slots;
+  memmove(frame->slots, callee->slots, count * sizeof(Value));
+  vm.stackTop = frame->slots + count;
+
+  frame->closure = callee->closure;
+  frame->ip = callee->ip;
+  vm.frameCount--;
+}
+
+bool vmImportAsInstance(ObjModule* module) {
+  vmPush(OBJ_VAL(vm.core.module));
+  if (!vmInitInstance(vm.core.module, 0)) return false;
+  ObjInstance* objModule = AS_INSTANCE(vmPeek(0));
+
+  if (!vmImport(module, instanceFields(objModule))) return false;
+
+  instanceSet(objModule, OBJ_VAL(vm.core.sModule), OBJ_VAL(module));
+
+  return true;
+}
+
+static bool assertInt(Value value, char* msg) {
+  if (!IS_INTEGER(value)) {
+    vmRuntimeError(msg);
+    return false;
+  }
+  return true;
+}
+
+static bool validateStrIdx(ObjString* str, Value idx) {
+  if (!assertInt(idx, "Strings must be indexed by integer.")) return false;
+  int intIdx = AS_NUMBER(idx);
+  if (intIdx > str->length - 1 || intIdx < 0) {
+    vmRuntimeError("Index %i out of bounds for string of length %i.", intIdx,
+                   str->length);
+    return false;
+  }
+
+  return true;
+}
+
+static bool validateSeqIdx(ObjSequence* seq, Value idx) {
+  if (!assertInt(idx, "Sequences must be indexed by integer.")) return false;
+  int intIdx = AS_NUMBER(idx);
+
+  if (intIdx > seq->values.count - 1 || intIdx < 0) {
+    vmRuntimeError("Index %i out of bounds for sequence of length %i.", intIdx,
+                   seq->values.count);
+    return false;
+  }
+
+  return true;
+}
+
+bool vmSequenceValueField(ObjInstance* obj, Value* seq) {
+  if (!instanceGet(obj, OBJ_VAL(vm.core.sValues), seq)) {
+    vmRuntimeError("Sequence instance missing its values!");
+    return false;
+  }
+  if (!IS_SEQUENCE(*seq)) {
+    vmRuntimeError("Expecting sequence.");
+    return false;
+  }
+  return true;
+}
+
+// Advance [iterator] without calling its methods when it's a core
+// Iterator over a Sequence, Tuple, or string, setting [hasMore] and
+// the [next] element. Anything else, including an index the methods
+// would fail on, is left to the iteration protocol.
+static bool iterateNatively(Value iterator, bool* hasMore, Value* next) {
+  if (!IS_INSTANCE(iterator)) return false;
+
+  ObjInstance* instance = AS_INSTANCE(iterator);
+  if (instance->klass != vm.core.iterator) return false;
+
+  Value seq, idx, end;
+  if (!instanceGet(instance, OBJ_VAL(vm.core.sSeq), &seq) ||
+      !instanceGet(instance, OBJ_VAL(vm.core.sIdx), &idx) ||
+      !instanceGet(instance, OBJ_VAL(vm.core.sEnd), &end) ||
+      !IS_INTEGER(idx) || !IS_NUMBER(end))
+    return false;
+
+  if (AS_NUMBER(idx) == AS_NUMBER(end)) {
+    *hasMore = false;
+    return true;
+  }
+
+  int i = AS_NUMBER(idx);
+
+  if (IS_STRING(seq)) {
+    ObjString* string = AS_STRING(seq);
+    if (i < 0 || i >= string->length) return false;
+
+    *next = OBJ_VAL(copyString(string->chars + i, 1));
+  } else if (IS_INSTANCE(seq) &&
+             (AS_INSTANCE(seq)->klass == vm.core.sequence ||
+              AS_INSTANCE(seq)->klass == vm.core.tuple)) {
+    Value values;
+    if (!instanceGet(AS_INSTANCE(seq), OBJ_VAL(vm.core.sValues), &values) ||
+        !IS_SEQUENCE(values))
+      return false;
+
+    ObjSequence* sequence = AS_SEQUENCE(values);
+    if (i < 0 || i >= sequence->values.count) return false;
+
+    *next = sequence->values.values[i];
+  } else {
+    return false;
+  }
+
+  // the new character is only reachable from here.
+  vmPush(*next);
+  instanceSet(instance, OBJ_VAL(vm.core.sIdx), NUMBER_VAL(i + 1));
+  vmPop();
+
+  *hasMore = true;
+  return true;
+}
+
+static bool vmInstanceHas(ObjInstance* instance, Value value) {
+  uint32_t hash;
+  if (!vmHashValue(value, &hash)) return false;
+
+  bool hasKey = instanceHasHash(instance, value, hash) ||
+                mapHasHash(&instance->klass->fields, value, hash);
+  vmPush(BOOL_VAL(hasKey));
+  return true;
+}
+
+// Loop until we're back to [baseFrame] frames. Typically this
+// is just 0, but if we want to execute a single function in the
+// middle of execution we can let [baseFrame] = the current frame.
+InterpretResult vmExecute(int baseFrame) {
+  if (vm.frameCount == baseFrame) return INTERPRET_OK;
+
+  CallFrame* frame = vmFrame(vm.frameCount - 1);
+  uint8_t instruction;
+
+#ifdef COMPUTED_GOTO
+  // one label per opcode, in [OpCode] order. opcodes without an
+  // entry fall through to [L_UNHANDLED]. note that jumping
+  // through the table never releases variable length arrays, so
+  // the cases below only use fixed size buffers.
+  static void* dispatchTable[UINT8_COUNT] = {
+      [OP_UNDEFINED] = &&L_OP_UNDEFINED,
+      [OP_CONSTANT] = &&L_OP_CONSTANT,
+      [OP_NIL] = &&L_OP_NIL,
+      [OP_TRUE] = &&L_OP_TRUE,
+      [OP_FALSE] = &&L_OP_FALSE,
+      [OP_POP] = &&L_OP_POP,
+      [OP_GET_LOCAL] = &&L_OP_GET_LOCAL,
+      [OP_SET_LOCAL] = &&L_OP_SET_LOCAL,
+      [OP_DEFINE_GLOBAL] = &&L_OP_DEFINE_GLOBAL,
+      [OP_GET_GLOBAL] = &&L_OP_GET_GLOBAL,
+      [OP_SET_GLOBAL] = &&L_OP_SET_GLOBAL,
+      [OP_GET_UPVALUE] = &&L_OP_GET_UPVALUE,
+      [OP_SET_UPVALUE] = &&L_OP_SET_UPVALUE,
+      [OP_GET_PROPERTY] = &&L_OP_GET_PROPERTY,
+      [OP_SET_PROPERTY] = &&L_OP_SET_PROPERTY,
+      [OP_GET_SUPER] = &&L_OP_GET_SUPER,
+      [OP_EQUAL] = &&L_OP_EQUAL,
+      [OP_NOT] = &&L_OP_NOT,
+      [OP_JUMP] = &&L_OP_JUMP,
+      [OP_JUMP_IF_FALSE] = &&L_OP_JUMP_IF_FALSE,
+      [OP_ITER] = &&L_OP_ITER,
+      [OP_LOOP] = &&L_OP_LOOP,
+      [OP_CALL] = &&L_OP_CALL,
+      [OP_CALL_SPREAD] = &&L_OP_CALL_SPREAD,
+      [OP_INVOKE] = &&L_OP_INVOKE,
+      [OP_INVOKE_SPREAD] = &&L_OP_INVOKE_SPREAD,
+      [OP_CALL_INFIX] = &&L_OP_CALL_INFIX,
+      [OP_ADD] = &&L_OP_ADD,
+      [OP_SUB] = &&L_OP_SUB,
+      [OP_MUL] = &&L_OP_MUL,
+      [OP_DIV] = &&L_OP_DIV,
+      [OP_LT] = &&L_OP_LT,
+      [OP_GT] = &&L_OP_GT,
+      [OP_LTE] = &&L_OP_LTE,
+      [OP_GTE] = &&L_OP_GTE,
+      [OP_CALL_POSTFIX] = &&L_OP_CALL_POSTFIX,
+      [OP_CLOSURE] = &&L_OP_CLOSURE,
+      [OP_COMPREHENSION] = &&L_OP_COMPREHENSION,
+      [OP_COMPREHENSION_PRED] = &&L_OP_COMPREHENSION_PRED,
+      [OP_COMPREHENSION_ITER] = &&L_OP_COMPREHENSION_ITER,
+      [OP_COMPREHENSION_BODY] = &&L_OP_COMPREHENSION_BODY,
+      [OP_OVERLOAD] = &&L_OP_OVERLOAD,
+      [OP_VARIABLE] = &&L_OP_VARIABLE,
+      [OP_SIGN] = &&L_OP_SIGN,
+      [OP_CLOSE_UPVALUE] = &&L_OP_CLOSE_UPVALUE,
+      [OP_RETURN] = &&L_OP_RETURN,
+      [OP_IMPLICIT_RETURN] = &&L_OP_IMPLICIT_RETURN,
+      [OP_CLASS] = &&L_OP_CLASS,
+      [OP_INHERIT] = &&L_OP_INHERIT,
+      [OP_METHOD] = &&L_OP_METHOD,
+      [OP_MEMBER] = &&L_OP_MEMBER,
+      [OP_IMPORT] = &&L_OP_IMPORT,
+      [OP_IMPORT_AS] = &&L_OP_IMPORT_AS,
+      [OP_IMPORT_FROM] = &&L_OP_IMPORT_FROM,
+      [OP_THROW] = &&L_OP_THROW,
+      [OP_SUBSCRIPT_GET] = &&L_OP_SUBSCRIPT_GET,
+      [OP_SUBSCRIPT_SET] = &&L_OP_SUBSCRIPT_SET,
+      [OP_EXPR_STATEMENT] = &&L_OP_EXPR_STATEMENT,
+      [OP_DESTRUCTURE] = &&L_OP_DESTRUCTURE,
+      [OP_SET_TYPE_LOCAL] = &&L_OP_SET_TYPE_LOCAL,
+      [OP_SET_TYPE_GLOBAL] = &&L_OP_SET_TYPE_GLOBAL,
+      [OP_SPREAD] = &&L_OP_SPREAD,
+      [OP_UNIT] = &&L_OP_UNIT,
+      [OP_QUANTIFY] = &&L_OP_QUANTIFY,
+      [OP_POPN] = &&L_OP_POPN,
+      [OP_SET_LOCAL_POP] = &&L_OP_SET_LOCAL_POP,
+      [OP_SET_GLOBAL_POP] = &&L_OP_SET_GLOBAL_POP,
+      [OP_GET_LOCAL_PROPERTY] = &&L_OP_GET_LOCAL_PROPERTY,
+      [OP_TAIL_CALL] = &&L_OP_TAIL_CALL,
+      [OP_TAIL_INVOKE] = &&L_OP_TAIL_INVOKE,
+  };
+
+#define CASE(op) L_##op
+#define DISPATCH()                                            \
+  do {                                                        \
+    TRACE_EXECUTION("");                                      \
+    instruction = READ_BYTE();                                \
+    if (dispatchTable[instruction] == NULL) goto L_UNHANDLED; \
+    goto* dispatchTable[instruction];                         \
+  } while (false)
+
+  DISPATCH();
+#else
+#define CASE(op) case op
+#define DISPATCH() goto loop
+
+loop:
+  TRACE_EXECUTION("");
+  switch (instruction = READ_BYTE())
+#endif
+
+  // operators run inline on numbers and skip over the name of the
+  // global they otherwise fall back to.
+#define BINARY_FALLBACK()                                               \
+  do {                                                                  \
+    if (!callOperator(frame)) return INTERPRET_RUNTIME_ERROR;           \
+    frame = vmFrame(vm.frameCount - 1);                              \
+    DISPATCH();                                                         \
+  } while (false)
+#define BINARY_OP(valueType, op)                                       \
+  do {                                                                 \
+    if (vm.nativeOperators && IS_NUMBER(vmPeek(0)) &&                  \
+        IS_NUMBER(vmPeek(1))) {                                        \
+      double b = AS_NUMBER(vmPop());                                   \
+      double a = AS_NUMBER(vmPop());                                   \
+      vmPush(valueType(a op b));                                       \
+      frame->ip += 2;                                                  \
+      DISPATCH();                                                      \
+    }                                                                  \
+    BINARY_FALLBACK();                                                 \
+  } while (false)
+
+  {
+    CASE(OP_UNDEFINED):
+      vmPush(UNDEF_VAL);
+      DISPATCH();
+    CASE(OP_CONSTANT): {
+      Value constant = READ_CONSTANT();
+      vmPush(constant);
+      DISPATCH();
+    }
+    CASE(OP_NIL):
+      vmPush(NIL_VAL);
+      DISPATCH();
+    CASE(OP_TRUE):
+      vmPush(BOOL_VAL(true));
+      DISPATCH();
+    CASE(OP_FALSE):
+      vmPush(BOOL_VAL(false));
+      DISPATCH();
+    CASE(OP_EXPR_STATEMENT):
+    CASE(OP_POP):
+      vmPop();
+      DISPATCH();
+    CASE(OP_POPN):
+      vm.stackTop -= READ_BYTE();
+      DISPATCH();
+    CASE(OP_GET_LOCAL): {
+      uint8_t slot = READ_SHORT();
+      vmPush(frame->slots[slot]);
+      DISPATCH();
+    }
+    CASE(OP_SET_LOCAL): {
+      uint8_t slot = READ_SHORT();
+      frame->slots[slot] = vmPeek(0);
+      DISPATCH();
+    }
+    CASE(OP_SET_LOCAL_POP): {
+      uint8_t slot = READ_SHORT();
+      frame->slots[slot] = vmPop();
+      DISPATCH();
+    }
+    CASE(OP_GET_GLOBAL): {
+      MapEntry* global = readGlobal(frame);
+      if (global == NULL) return INTERPRET_RUNTIME_ERROR;
+
+      vmPush(global->value);
+      DISPATCH();
+    }
+    CASE(OP_DEFINE_GLOBAL): {
+      Value name = READ_CONSTANT();
+      ObjMap* target = vm.module->type == MODULE_ENTRYPOINT
+                           ? &vm.globals
+                           : &vm.module->namespace;
+      if (isNativeOperator(name)) vm.nativeOperators = false;
+      mapSet(target, name, vmPeek(0));
+      vmPop();
+      DISPATCH();
+    }
+    CASE(OP_SET_GLOBAL): {
+      MapEntry* global = readGlobal(frame);
+      if (global == NULL) return INTERPRET_RUNTIME_ERROR;
+
+      if (isNativeOperator(global->key)) vm.nativeOperators = false;
+      global->value = vmPeek(0);
+      // the entry is in the module's namespace or the globals,
+      // which are a root.
+      writeBarrier(&vm.module->namespace.obj, global->value);
+      DISPATCH();
+    }
+    CASE(OP_SET_GLOBAL_POP): {
+      MapEntry* global = readGlobal(frame);
+      if (global == NULL) return INTERPRET_RUNTIME_ERROR;
+
+      if (isNativeOperator(global->key)) vm.nativeOperators = false;
+      global->value = vmPop();
+      writeBarrier(&vm.module->namespace.obj, global->value);
+      DISPATCH();
+    }
+    CASE(OP_GET_PROPERTY): {
+      Chunk* chunk = &frame->closure->function->chunk;
+      if (!getProperty(chunk, READ_SHORT())) return INTERPRET_RUNTIME_ERROR;
+      DISPATCH();
+    }
+    CASE(OP_GET_LOCAL_PROPERTY): {
+      Chunk* chunk = &frame->closure->function->chunk;
+      uint8_t slot = READ_SHORT();
+      vmPush(frame->slots[slot]);
+      if (!getProperty(chunk, READ_SHORT())) return INTERPRET_RUNTIME_ERROR;
+      DISPATCH();
+    }
+    CASE(OP_SET_PROPERTY): {
+      Chunk* chunk = &frame->closure->function->chunk;
+      uint16_t constant = READ_SHORT();
+      Value name = chunk->constants.values[constant];
+      ObjMap* fields;
+
+      char* error = "Can only set property of object, class, or function.";
+
+      if (!IS_OBJ(vmPeek(1))) {
+        vmRuntimeError(error);
+        return INTERPRET_RUNTIME_ERROR;
       }
-      case OP_EQUAL: {
-        Value a = vmPop();
-        Value b = vmPop();
-
-        // classes can override the equality relation.
-        if (IS_INSTANCE(a) && IS_INSTANCE(b)) {
-          ObjInstance* instanceA = AS_INSTANCE(a);
-          ObjInstance* instanceB = AS_INSTANCE(b);
-
-          Value equalFn;
-          ObjClass lca;
-          if (leastCommonAncestor(instanceA->klass, instanceB->klass, &lca) &&
-              mapGet(&lca.fields, INTERN(S_EQ), &equalFn)) {
-            vmPush(b);
-            vmPush(a);
-            if (!vmCallValue(equalFn, 1)) return INTERPRET_RUNTIME_ERROR;
-
-            frame = &vm.frames[vm.frameCount - 1];
-            break;
+
+      switch (OBJ_TYPE(vmPeek(1))) {
+        case OBJ_INSTANCE:
+          setField(chunk, constant, AS_INSTANCE(vmPeek(1)), vmPeek(0));
+          vmPop();
+          DISPATCH();
+        case OBJ_CLASS:
+          vmClassSet(AS_CLASS(vmPeek(1)), name, vmPeek(0));
+          vmPop();
+          DISPATCH();
+        case OBJ_BOUND_FUNCTION: {
+          ObjBoundFunction* obj = AS_BOUND_FUNCTION(vmPeek(1));
+          if (obj->type == BOUND_NATIVE) {
+            vmRuntimeError("Can't set property of native.");
+            return INTERPRET_RUNTIME_ERROR;
           }
+          fields = &obj->bound.method->function->fields;
+          break;
         }
+        case OBJ_CLOSURE:
+          fields = &AS_CLOSURE(vmPeek(1))->function->fields;
+          break;
+        default:
+          vmRuntimeError(error);
+          return INTERPRET_RUNTIME_ERROR;
+      }
 
-        vmPush(BOOL_VAL(valuesEqual(a, b)));
-        break;
+      mapSet(fields, name, vmPeek(0));
+      vmPop();
+      DISPATCH();
+    }
+    CASE(OP_EQUAL): {
+      Value a = vmPop();
+      Value b = vmPop();
+
+      // classes can override the equality relation.
+      if (IS_INSTANCE(a) && IS_INSTANCE(b)) {
+        ObjInstance* instanceA = AS_INSTANCE(a);
+        ObjInstance* instanceB = AS_INSTANCE(b);
+
+        ObjClass* lca = leastCommonAncestor(instanceA->klass, instanceB->klass);
+        if (lca != NULL && !IS_UNDEF(lca->protocol[PROTOCOL_EQ])) {
+          Value equalFn = lca->protocol[PROTOCOL_EQ];
+          vmPush(b);
+          vmPush(a);
+          if (!vmCallValue(equalFn, 1)) return INTERPRET_RUNTIME_ERROR;
+
+          frame = vmFrame(vm.frameCount - 1);
+          DISPATCH();
+        }
       }
-      case OP_GET_SUPER: {
-        Value name = READ_CONSTANT();
-        Value value = NIL_VAL;
 
-        mapGet(&AS_CLASS(vmPeek(0))->fields, name, &value);
+      vmPush(BOOL_VAL(valuesEqual(a, b)));
+      DISPATCH();
+    }
+    CASE(OP_GET_SUPER): {
+      Value name = READ_CONSTANT();
+      Value value = NIL_VAL;
 
-        bindClosure(vmPeek(1), &value);
+      mapGet(&AS_CLASS(vmPeek(0))->fields, name, &value);
 
-        vmPop();  // superclass.
-        vmPop();  // instance.
-        vmPush(value);
+      bindClosure(vmPeek(1), &value);
 
-        break;
-      }
-      case OP_GET_UPVALUE: {
-        uint8_t slot = READ_SHORT();
-        vmPush(*frame->closure->upvalues[slot]->location);
-        break;
-      }
-      case OP_SET_UPVALUE: {
-        uint8_t slot = READ_SHORT();
-        *frame->closure->upvalues[slot]->location = vmPeek(0);
-        break;
-      }
-      case OP_NOT:
-        vmPush(BOOL_VAL(isFalsey(vmPop())));
-        break;
-      case OP_JUMP: {
-        uint16_t offset = READ_SHORT();
-        frame->ip += offset;
-        break;
-      }
-      case OP_JUMP_IF_FALSE:
-      case OP_COMPREHENSION_PRED: {
-        uint16_t offset = READ_SHORT();
-        if (isFalsey(vmPeek(0))) frame->ip += offset;
-        break;
-      }
+      vmPop();  // superclass.
+      vmPop();  // instance.
+      vmPush(value);
 
-      case OP_ITER:
-      case OP_COMPREHENSION_ITER: {
-        uint16_t offset = READ_SHORT();
-        uint8_t* ip = frame->ip;
-        uint16_t local = READ_SHORT();
-        Value iterator = vmPeek(0);
+      DISPATCH();
+    }
+    CASE(OP_GET_UPVALUE): {
+      uint8_t slot = READ_SHORT();
+      vmPush(*frame->closure->upvalues[slot]->location);
+      DISPATCH();
+    }
+    CASE(OP_SET_UPVALUE): {
+      uint8_t slot = READ_SHORT();
+      ObjUpvalue* upvalue = frame->closure->upvalues[slot];
+      *upvalue->location = vmPeek(0);
+      writeBarrier((Obj*)upvalue, vmPeek(0));
+      DISPATCH();
+    }
+    CASE(OP_NOT):
+      vmPush(BOOL_VAL(isFalsey(vmPop())));
+      DISPATCH();
+    CASE(OP_JUMP): {
+      uint16_t offset = READ_SHORT();
+      frame->ip += offset;
+      DISPATCH();
+    }
+    CASE(OP_JUMP_IF_FALSE):
+    CASE(OP_COMPREHENSION_PRED): {
+      uint16_t offset = READ_SHORT();
+      if (isFalsey(vmPeek(0))) frame->ip += offset;
+      DISPATCH();
+    }
 
+    CASE(OP_ITER):
+    CASE(OP_COMPREHENSION_ITER): {
+      uint16_t offset = READ_SHORT();
+      uint8_t* ip = frame->ip;
+      uint16_t local = READ_SHORT();
+      Value iterator = vmPeek(0);
+      bool hasMore;
+      Value next;
+
+      if (!iterateNatively(iterator, &hasMore, &next)) {
         vmPush(iterator);
-        if (!vmExecuteMethod("more", 0)) return INTERPRET_RUNTIME_ERROR;
-        Value hasMore = vmPop();
-        if (!IS_BOOL(hasMore)) {
+        if (!executeProtocol(PROTOCOL_MORE, 0))
+          return INTERPRET_RUNTIME_ERROR;
+        Value more = vmPop();
+        if (!IS_BOOL(more)) {
           vmRuntimeError("more() must return a boolean value.");
           return INTERPRET_RUNTIME_ERROR;
         }
-        if (AS_BOOL(hasMore)) {
+
+        hasMore = AS_BOOL(more);
+        if (hasMore) {
           vmPush(iterator);
-          if (!vmExecuteMethod("next", 0)) return INTERPRET_RUNTIME_ERROR;
-          frame->slots[local] = vmPop();
-        } else {
-          frame->ip = ip + offset;
+          if (!executeProtocol(PROTOCOL_NEXT, 0))
+            return INTERPRET_RUNTIME_ERROR;
+          next = vmPop();
         }
-        break;
-      }
-      case OP_LOOP: {
-        uint16_t offset = READ_SHORT();
-        frame->ip -= offset;
-        break;
       }
-      case OP_CALL: {
-        int argCount = READ_BYTE();
-        Value caller = vmPeek(argCount);
-        Value args[argCount];
-        bool instantiate =
-            IS_OBJ(caller) && AS_OBJ(caller)->annotations.count > 0;
-
-        // if the caller has a type annotation then calculate its range.
-        if (instantiate) {
-          for (int i = argCount; i > 0; i--) args[i - 1] = vmPop();
-          Value caller = vmPop();
-
-          vmPush(OBJ_VAL(vm.core.typeSystem));
-          vmPush(caller);
-          for (int i = 0; i < argCount; i++) vmPush(args[i]);
-          if (!vmExecuteMethod("instantiate", argCount + 1))
-            return INTERPRET_RUNTIME_ERROR;
-          frame = &vm.frames[vm.frameCount - 1];
 
-          // set up the call.
-          vmPush(caller);
-          for (int i = 0; i < argCount; i++) vmPush(args[i]);
-        }
+      if (hasMore)
+        frame->slots[local] = next;
+      else
+        frame->ip = ip + offset;
+      DISPATCH();
+    }
+    CASE(OP_LOOP): {
+      uint16_t offset = READ_SHORT();
+      frame->ip -= offset;
+      DISPATCH();
+    }
+    CASE(OP_CALL): {
+      if (!call(READ_BYTE())) return INTERPRET_RUNTIME_ERROR;
 
-        if (!vmCallValue(caller, argCount) ||
-            vmExecute(vm.frameCount - 1) != INTERPRET_OK)
-          return INTERPRET_RUNTIME_ERROR;
-        frame = &vm.frames[vm.frameCount - 1];
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_TAIL_CALL): {
+      // the instruction after is a return, run only if the
+      // callee can't take over the frame.
+      if (!call(READ_BYTE())) return INTERPRET_RUNTIME_ERROR;
+
+      tailCall(frame);
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_CALL_SPREAD): {
+      int argCount = READ_BYTE();
+      if (!spread(&argCount) || !call(argCount))
+        return INTERPRET_RUNTIME_ERROR;
+
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_INVOKE): {
+      Chunk* chunk = &frame->closure->function->chunk;
+      uint16_t constant = READ_SHORT();
+      if (!invoke(chunk, constant, READ_BYTE()))
+        return INTERPRET_RUNTIME_ERROR;
+
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_TAIL_INVOKE): {
+      Chunk* chunk = &frame->closure->function->chunk;
+      uint16_t constant = READ_SHORT();
+      if (!invoke(chunk, constant, READ_BYTE()))
+        return INTERPRET_RUNTIME_ERROR;
+
+      tailCall(frame);
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_INVOKE_SPREAD): {
+      Chunk* chunk = &frame->closure->function->chunk;
+      uint16_t constant = READ_SHORT();
+      int argCount = READ_BYTE();
+      if (!spread(&argCount) || !invoke(chunk, constant, argCount))
+        return INTERPRET_RUNTIME_ERROR;
 
-        if (instantiate) {
-          Value result = vmPeek(0);
-          Value annotation = vmPeek(1);
-          if (IS_OBJ(result))
-            writeValueArray(&AS_OBJ(result)->annotations, annotation);
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_CALL_INFIX): {
+      if (!callInfix(READ_CONSTANT())) return INTERPRET_RUNTIME_ERROR;
+
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_ADD): {
+      if (vm.nativeOperators) {
+        if (IS_NUMBER(vmPeek(0)) && IS_NUMBER(vmPeek(1))) {
+          double b = AS_NUMBER(vmPop());
+          double a = AS_NUMBER(vmPop());
+          vmPush(NUMBER_VAL(a + b));
+          frame->ip += 2;
+          DISPATCH();
+        }
+        if (IS_STRING(vmPeek(0)) && IS_STRING(vmPeek(1))) {
+          // pop after concatenating, which may collect.
+          ObjString* result = concatenateStrings(AS_STRING(vmPeek(1)),
+                                                 AS_STRING(vmPeek(0)));
           vmPop();
           vmPop();
-          vmPush(result);
+          vmPush(OBJ_VAL(result));
+          frame->ip += 2;
+          DISPATCH();
         }
-
-        break;
       }
-      case OP_CALL_INFIX: {
-        Value name = READ_CONSTANT();
-
-        Value right = vmPeek(0);
-        Value infix = vmPeek(1);
-        Value left = vmPeek(2);
-
-        if (IS_INSTANCE(left) && IS_INSTANCE(right)) {
-          ObjClass lca;
-          if (leastCommonAncestor(AS_INSTANCE(left)->klass,
-                                  AS_INSTANCE(right)->klass, &lca)) {
-            Value method;
-            if (mapGet(&lca.fields, name, &method)) {
-              vmPop();
-              vmPop();
-              vmPush(right);
-              if (!vmCallValue(method, 1)) return INTERPRET_RUNTIME_ERROR;
-
-              frame = &vm.frames[vm.frameCount - 1];
-              break;
-            }
-          }
-        }
+      BINARY_FALLBACK();
+    }
+    CASE(OP_SUB):
+      BINARY_OP(NUMBER_VAL, -);
+    CASE(OP_MUL):
+      BINARY_OP(NUMBER_VAL, *);
+    CASE(OP_DIV):
+      BINARY_OP(NUMBER_VAL, /);
+    CASE(OP_LT):
+      BINARY_OP(BOOL_VAL, <);
+    CASE(OP_GT):
+      BINARY_OP(BOOL_VAL, >);
+    CASE(OP_LTE):
+      BINARY_OP(BOOL_VAL, <=);
+    CASE(OP_GTE):
+      BINARY_OP(BOOL_VAL, >=);
+    CASE(OP_CALL_POSTFIX): {
+      int argCount = READ_BYTE();
+      Value postfix = vmPop();
+      Value args[UINT8_COUNT];
+
+      int i = argCount;
+      while (i-- > 0) args[i] = vmPop();
+      vmPush(postfix);
+      while (++i < argCount) vmPush(args[i]);
+
+      if (!vmCallValue(postfix, argCount)) return INTERPRET_RUNTIME_ERROR;
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_CLOSURE): {
+      vmClosure(frame);
+      DISPATCH();
+    }
+    CASE(OP_COMPREHENSION): {
+      Value obj = vmPeek(0);
+      if (vm.comprehensionDepth == COMPREHENSION_DEPTH_MAX) {
+        vmRuntimeError("Can't next comprehensions deeper than %s.",
+                       COMPREHENSION_DEPTH_MAX);
+        return INTERPRET_RUNTIME_ERROR;
+      }
 
-        if (IS_UNDEF(infix)) {
-          vmRuntimeError("Undefined variable '%s'.", AS_STRING(name)->chars);
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      vm.comprehensions[vm.comprehensionDepth++] = AS_OBJ(obj);
 
-        vmPop();
-        vmPop();
-        vmPop();
+      vmClosure(frame);
+      if (!callClosure(AS_CLOSURE(vmPeek(0)), 0))
+        return INTERPRET_RUNTIME_ERROR;
 
-        vmPush(infix);
-        vmPush(left);
-        vmPush(right);
+      frame = vmFrame(vm.frameCount - 1);
+      frame->type = FRAME_COMPREHENSION;
+      DISPATCH();
+    }
+    CASE(OP_COMPREHENSION_BODY): {
+      Obj* comp;
+      if ((comp = vm.comprehensions[vm.comprehensionDepth - 1]) == NULL) {
+        vmRuntimeError("Missing comprehension at depth %d.",
+                       vm.comprehensionDepth);
+        return INTERPRET_RUNTIME_ERROR;
+      }
 
-        if (!vmCallValue(infix, 2)) return INTERPRET_RUNTIME_ERROR;
+      Value el = vmPeek(0);
+      bool added;
+      if (!comprehensionAdd(comp, el, &added)) return INTERPRET_RUNTIME_ERROR;
+      if (added) DISPATCH();
 
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_CALL_POSTFIX: {
-        int argCount = READ_BYTE();
-        Value postfix = vmPop();
-        Value args[argCount];
-
-        int i = argCount;
-        while (i-- > 0) args[i] = vmPop();
-        vmPush(postfix);
-        while (++i < argCount) vmPush(args[i]);
-
-        if (!vmCallValue(postfix, argCount)) return INTERPRET_RUNTIME_ERROR;
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_CLOSURE: {
-        vmClosure(frame);
-        break;
-      }
-      case OP_COMPREHENSION: {
-        Value obj = vmPeek(0);
-        if (vm.comprehensionDepth == COMPREHENSION_DEPTH_MAX) {
-          vmRuntimeError("Can't next comprehensions deeper than %s.",
-                         COMPREHENSION_DEPTH_MAX);
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      vmPush(OBJ_VAL(comp));
+      vmPush(el);
 
-        vm.comprehensions[vm.comprehensionDepth++] = AS_OBJ(obj);
+      if (!executeProtocol(PROTOCOL_ADD, 1)) return INTERPRET_RUNTIME_ERROR;
 
-        vmClosure(frame);
-        if (!vmCallValue(vmPeek(0), 0) ||
-            vmExecute(vm.frameCount - 1) != INTERPRET_OK)
-          return INTERPRET_RUNTIME_ERROR;
-        vmPop();  // nil.
+      vmPop();
+      DISPATCH();
+    }
+    CASE(OP_OVERLOAD): {
+      if (!vmOverload(frame)) return INTERPRET_RUNTIME_ERROR;
+      DISPATCH();
+    }
+    CASE(OP_VARIABLE): {
+      vmVariable(frame);
+      DISPATCH();
+    }
+    CASE(OP_SIGN): {
+      ObjClosure* closure = AS_CLOSURE(vmPeek(0));
+      vmClosure(frame);  // create the signature.
 
-        vm.comprehensions[--vm.comprehensionDepth] = NULL;
-        break;
-      }
-      case OP_COMPREHENSION_BODY: {
-        Obj* comp;
-        if ((comp = vm.comprehensions[vm.comprehensionDepth - 1]) == NULL) {
-          vmRuntimeError("Missing comprehension at depth %d.",
-                         vm.comprehensionDepth);
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      mapSet(&closure->function->fields, OBJ_VAL(vm.core.sSignature),
+             vmPeek(0));
 
-        Value el = vmPeek(0);
-        vmPush(OBJ_VAL(comp));
-        vmPush(el);
+      // pop the signature and leave the signed
+      // function on the stack.
+      vmPop();
+      DISPATCH();
+    }
+    CASE(OP_CLOSE_UPVALUE): {
+      vmCloseUpvalues(vm.stackTop - 1);
+      vmPop();
+      DISPATCH();
+    }
+    CASE(OP_IMPLICIT_RETURN):
+    CASE(OP_RETURN): {
+      Value value = vmPop();
 
-        if (!vmExecuteMethod("add", 1)) return INTERPRET_RUNTIME_ERROR;
+      vmCloseUpvalues(frame->slots);
+      vm.frameCount--;
 
+      if (vm.frameCount == 0) {
         vmPop();
-        break;
+        return INTERPRET_OK;
       }
-      case OP_OVERLOAD: {
-        if (!vmOverload(frame)) return INTERPRET_RUNTIME_ERROR;
-        break;
-      }
-      case OP_VARIABLE: {
-        vmVariable(frame);
-        break;
+
+      vm.stackTop = frame->slots;
+
+      switch (frame->type) {
+        case FRAME_CALL:
+          vmPush(value);
+          break;
+        case FRAME_ANNOTATED_CALL:
+          vmPush(value);
+          if (!annotateResult()) return INTERPRET_RUNTIME_ERROR;
+          break;
+        case FRAME_COMPREHENSION:
+          vm.comprehensions[--vm.comprehensionDepth] = NULL;
+          break;
+        case FRAME_IMPORT:
+          endImport(frame);
+          break;
       }
-      case OP_SIGN: {
-        ObjClosure* closure = AS_CLOSURE(vmPeek(0));
-        vmClosure(frame);  // create the signature.
 
-        mapSet(&closure->function->fields, OBJ_VAL(vm.core.sSignature),
-               vmPeek(0));
+      if (vm.frameCount == baseFrame) return INTERPRET_OK;
 
-        // pop the signature and leave the signed
-        // function on the stack.
-        vmPop();
-        break;
-      }
-      case OP_CLOSE_UPVALUE: {
-        vmCloseUpvalues(vm.stackTop - 1);
-        vmPop();
-        break;
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_CLASS):
+      vmPush(OBJ_VAL(newClass(READ_STRING())));
+      DISPATCH();
+    CASE(OP_INHERIT): {
+      Value superclass = vmPeek(1);
+
+      if (!IS_CLASS(superclass)) {
+        vmRuntimeError("Superclass must be a class.");
+        return INTERPRET_RUNTIME_ERROR;
       }
-      case OP_IMPLICIT_RETURN:
-      case OP_RETURN: {
-        Value value = vmPop();
 
-        vmCloseUpvalues(frame->slots);
-        vm.frameCount--;
-
-        if (vm.frameCount == 0) {
-          vmPop();
-          return INTERPRET_OK;
-        }
+      vmExtendClass(AS_CLASS(vmPeek(0)), AS_CLASS(superclass));
+      vmPop();  // Subclass.
+      DISPATCH();
+    }
+    CASE(OP_METHOD): {
+      Value name = READ_CONSTANT();
+      Value method = vmPeek(0);
+      ObjClass* klass = AS_CLASS(vmPeek(1));
+      vmClassSet(klass, name, method);
+      vmPop();
+      DISPATCH();
+    }
+    CASE(OP_MEMBER): {
+      Value obj = vmPop();
+      Value val = vmPop();
 
-        vm.stackTop = frame->slots;
-        vmPush(value);
+      char* error =
+          "Only objects, classes, and sequences may be tested for "
+          "membership.";
 
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
+      if (!IS_OBJ(obj)) {
+        vmRuntimeError(error);
+        return INTERPRET_RUNTIME_ERROR;
       }
-      case OP_CLASS:
-        vmPush(OBJ_VAL(newClass(READ_STRING())));
-        break;
-      case OP_INHERIT: {
-        Value superclass = vmPeek(1);
 
-        if (!IS_CLASS(superclass)) {
-          vmRuntimeError("Superclass must be a class.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      switch (OBJ_TYPE(obj)) {
+        case OBJ_INSTANCE: {
+          ObjInstance* instance = AS_INSTANCE(obj);
 
-        vmExtendClass(AS_CLASS(vmPeek(0)), AS_CLASS(superclass));
-        vmPop();  // Subclass.
-        break;
-      }
-      case OP_METHOD: {
-        Value name = READ_CONSTANT();
-        Value method = vmPeek(0);
-        ObjClass* klass = AS_CLASS(vmPeek(1));
-        mapSet(&klass->fields, name, method);
-        vmPop();
-        break;
-      }
-      case OP_MEMBER: {
-        Value obj = vmPop();
-        Value val = vmPop();
+          // classes can override the membership predicate.
+          Value memFn = instance->klass->protocol[PROTOCOL_IN];
+          if (!IS_UNDEF(memFn)) {
+            vmPush(obj);
+            vmPush(val);
 
-        char* error =
-            "Only objects, classes, and sequences may be tested for "
-            "membership.";
+            if (!vmCallValue(memFn, 1)) return INTERPRET_RUNTIME_ERROR;
 
-        if (!IS_OBJ(obj)) {
+            frame = vmFrame(vm.frameCount - 1);
+            break;
+          }
+
+          // otherwise check the fields.
+          if (!vmInstanceHas(instance, val)) return INTERPRET_RUNTIME_ERROR;
+          break;
+        }
+        case OBJ_CLASS: {
+          ObjClass* klass = AS_CLASS(obj);
+          uint32_t hash;
+          if (!vmHashValue(val, &hash)) return false;
+
+          bool hasKey = mapHasHash(&klass->fields, val, hash);
+          vmPush(BOOL_VAL(hasKey));
+          break;
+        }
+        default: {
           vmRuntimeError(error);
           return INTERPRET_RUNTIME_ERROR;
         }
+      }
 
-        switch (OBJ_TYPE(obj)) {
-          case OBJ_INSTANCE: {
-            ObjInstance* instance = AS_INSTANCE(obj);
-
-            // classes can override the membership predicate.
-            Value memFn;
-            if (mapGet(&instance->klass->fields, INTERN(S_IN), &memFn)) {
-              vmPush(obj);
-              vmPush(val);
-
-              if (!vmCallValue(memFn, 1)) return INTERPRET_RUNTIME_ERROR;
+      DISPATCH();
+    }
+    CASE(OP_IMPORT): {
+      ObjModule* module = AS_MODULE(READ_CONSTANT());
+      if (!beginImport(module)) return INTERPRET_RUNTIME_ERROR;
+      frame = vmFrame(vm.frameCount - 1);
+      DISPATCH();
+    }
+    CASE(OP_IMPORT_AS): {
+      ObjModule* module = AS_MODULE(READ_CONSTANT());
+      Value alias = READ_CONSTANT();
 
-              frame = &vm.frames[vm.frameCount - 1];
-              break;
-            }
+      if (!vmImportAsInstance(module)) return INTERPRET_RUNTIME_ERROR;
+      frame = vmFrame(vm.frameCount - 1);
 
-            // otherwise check the fields.
-            if (!vmInstanceHas(instance, val)) return INTERPRET_RUNTIME_ERROR;
-            break;
-          }
-          case OBJ_CLASS: {
-            ObjClass* klass = AS_CLASS(obj);
-            uint32_t hash;
-            if (!vmHashValue(val, &hash)) return false;
+      ObjInstance* objModule = AS_INSTANCE(vmPeek(0));
+      mapSet(&vm.globals, alias, OBJ_VAL(objModule));
+      instanceSet(objModule, OBJ_VAL(vm.core.sModule), OBJ_VAL(module));
 
-            bool hasKey = mapHasHash(&klass->fields, val, hash);
-            vmPush(BOOL_VAL(hasKey));
-            break;
-          }
-          default: {
-            vmRuntimeError(error);
-            return INTERPRET_RUNTIME_ERROR;
-          }
+      vmPop();  // objModule.
+      DISPATCH();
+    }
+    CASE(OP_IMPORT_FROM): {
+      ObjModule* module = AS_MODULE(READ_CONSTANT());
+      int vars = READ_BYTE();
+      ObjMap* target = importTarget();
+
+      vmPush(OBJ_VAL(module));
+      if (!vmCallModule(module)) return INTERPRET_RUNTIME_ERROR;
+      frame = vmFrame(vm.frameCount - 1);
+
+      while (vars-- > 0) {
+        Value key = READ_CONSTANT();
+        if (!IS_STRING(key)) {
+          vmRuntimeError("Import identifier must be string.");
+          return INTERPRET_RUNTIME_ERROR;
+        }
+        Value val;
+        if (!mapGet(&module->namespace, key, &val)) {
+          vmRuntimeError("%s has no identifier '%s' ",
+                         module->baseName->chars, AS_STRING(key)->chars);
+          return INTERPRET_RUNTIME_ERROR;
         }
 
-        break;
+        mapSet(target, key, val);
       }
-      case OP_IMPORT: {
-        ObjModule* module = AS_MODULE(READ_CONSTANT());
-        ObjMap* target = vm.module->type == MODULE_ENTRYPOINT
-                             ? &vm.globals
-                             : &vm.module->namespace;
-        if (!vmImport(module, target)) return INTERPRET_RUNTIME_ERROR;
-        frame = &vm.frames[vm.frameCount - 1];
-        break;
-      }
-      case OP_IMPORT_AS: {
-        ObjModule* module = AS_MODULE(READ_CONSTANT());
-        Value alias = READ_CONSTANT();
-
-        if (!vmImportAsInstance(module)) return INTERPRET_RUNTIME_ERROR;
-        frame = &vm.frames[vm.frameCount - 1];
 
-        ObjInstance* objModule = AS_INSTANCE(vmPeek(0));
-        mapSet(&vm.globals, alias, OBJ_VAL(objModule));
-        mapSet(&objModule->fields, OBJ_VAL(vm.core.sModule), OBJ_VAL(module));
+      DISPATCH();
+    }
+    CASE(OP_THROW): {
+      Value value = vmPop();
 
-        vmPop();  // objModule.
-        break;
+      if (!IS_INSTANCE(value)) {
+        vmRuntimeError("Can only throw instance of 'Error'.");
+        return INTERPRET_RUNTIME_ERROR;
       }
-      case OP_IMPORT_FROM: {
-        ObjModule* module = AS_MODULE(READ_CONSTANT());
-        int vars = READ_BYTE();
-        ObjMap* target = vm.module->type == MODULE_ENTRYPOINT
-                             ? &vm.globals
-                             : &vm.module->namespace;
-
-        vmPush(OBJ_VAL(module));
-        if (!vmCallModule(module)) return INTERPRET_RUNTIME_ERROR;
-        frame = &vm.frames[vm.frameCount - 1];
-
-        while (vars-- > 0) {
-          Value key = READ_CONSTANT();
-          if (!IS_STRING(key)) {
-            vmRuntimeError("Import identifier must be string.");
-            return INTERPRET_RUNTIME_ERROR;
-          }
-          Value val;
-          if (!mapGet(&module->namespace, key, &val)) {
-            vmRuntimeError("%s has no identifier '%s' ",
-                           module->baseName->chars, AS_STRING(key)->chars);
-            return INTERPRET_RUNTIME_ERROR;
-          }
 
-          mapSet(target, key, val);
-        }
-
-        break;
+      Value msg;
+      if (!instanceGet(AS_INSTANCE(value), INTERN("message"), &msg)) {
+        vmRuntimeError("Error must define a 'message'.");
+        return INTERPRET_RUNTIME_ERROR;
       }
-      case OP_THROW: {
-        Value value = vmPop();
 
-        if (!IS_INSTANCE(value)) {
-          vmRuntimeError("Can only throw instance of 'Error'.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
-
-        Value msg;
-        if (!mapGet(&AS_INSTANCE(value)->fields, INTERN("message"), &msg)) {
-          vmRuntimeError("Error must define a 'message'.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      if (!IS_STRING(msg)) {
+        vmRuntimeError("Error 'message' must be a string.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
 
-        if (!IS_STRING(msg)) {
-          vmRuntimeError("Error 'message' must be a string.");
-          return INTERPRET_RUNTIME_ERROR;
-        }
+      vmRuntimeError("%s: %s", AS_INSTANCE(value)->klass->name->chars,
+                     AS_STRING(msg)->chars);
+      return INTERPRET_RUNTIME_ERROR;
+    }
+    CASE(OP_SUBSCRIPT_GET): {
+      Value key = vmPop();
+      Value obj = vmPop();
 
-        vmRuntimeError("%s: %s", AS_INSTANCE(value)->klass->name->chars,
-                       AS_STRING(msg)->chars);
+      if (!IS_OBJ(obj)) {
+        vmRuntimeError("Only objects support subscription.");
         return INTERPRET_RUNTIME_ERROR;
       }
-      case OP_SUBSCRIPT_GET: {
-        Value key = vmPop();
-        Value obj = vmPop();
 
-        if (!IS_OBJ(obj)) {
-          vmRuntimeError("Only objects support subscription.");
-          return INTERPRET_RUNTIME_ERROR;
+      switch (OBJ_TYPE(obj)) {
+        case OBJ_SEQUENCE: {
+          ObjSequence* seq = AS_SEQUENCE(obj);
+          if (!validateSeqIdx(seq, key)) return INTERPRET_RUNTIME_ERROR;
+          int idx = AS_NUMBER(key);
+          vmPush(seq->values.values[idx]);
+          break;
+        }
+        case OBJ_STRING: {
+          ObjString* string = AS_STRING(obj);
+          if (!validateStrIdx(string, key)) return INTERPRET_RUNTIME_ERROR;
+          int idx = AS_NUMBER(key);
+          ObjString* character = copyString(string->chars + idx, 1);
+          vmPush(OBJ_VAL(character));
+          break;
         }
+        case OBJ_CLASS: {
+          ObjClass* klass = AS_CLASS(obj);
+          uint32_t hash;
+          if (!vmHashValue(key, &hash)) return INTERPRET_RUNTIME_ERROR;
 
-        switch (OBJ_TYPE(obj)) {
-          case OBJ_SEQUENCE: {
-            ObjSequence* seq = AS_SEQUENCE(obj);
-            if (!validateSeqIdx(seq, key)) return INTERPRET_RUNTIME_ERROR;
-            int idx = AS_NUMBER(key);
-            vmPush(seq->values.values[idx]);
-            break;
-          }
-          case OBJ_STRING: {
-            ObjString* string = AS_STRING(obj);
-            if (!validateStrIdx(string, key)) return INTERPRET_RUNTIME_ERROR;
-            int idx = AS_NUMBER(key);
-            ObjString* character = copyString(string->chars + idx, 1);
-            vmPush(OBJ_VAL(character));
-            break;
-          }
-          case OBJ_CLASS: {
-            ObjClass* klass = AS_CLASS(obj);
-            uint32_t hash;
-            if (!vmHashValue(key, &hash)) return INTERPRET_RUNTIME_ERROR;
-
-            Value value;
-            if (mapGetHash(&klass->fields, key, &value, hash)) {
-              vmPush(value);
-            } else {
-              // we don't throw an error if the property doesn't exist.
-              vmPush(NIL_VAL);
-            }
-            break;
+          Value value;
+          if (mapGetHash(&klass->fields, key, &value, hash)) {
+            vmPush(value);
+          } else {
+            // we don't throw an error if the property doesn't exist.
+            vmPush(NIL_VAL);
           }
-          case OBJ_INSTANCE: {
-            // classes may define their own subscript access operator.
-            ObjInstance* instance = AS_INSTANCE(obj);
-            Value getFn;
-            if (mapGet(&instance->klass->fields, INTERN(S_SUBSCRIPT_GET),
-                       &getFn)) {
-              // set up the context for the function call.
-              vmPush(obj);  // receiver.
-              vmPush(key);
-
-              if (!vmCallValue(getFn, 1)) return INTERPRET_RUNTIME_ERROR;
-              frame = &vm.frames[vm.frameCount - 1];
-              break;
-            }
-
-            // otherwise fall back to property access.
-            uint32_t hash;
-            if (!vmHashValue(key, &hash)) return INTERPRET_RUNTIME_ERROR;
-
-            Value value;
-            if (mapGetHash(&instance->fields, key, &value, hash)) {
-              vmPush(value);
-            } else if (mapGet(&instance->klass->fields, key, &value)) {
-              bindClosure(obj, &value);
-              vmPush(value);
-            } else {
-              // we don't throw an error if the property doesn't exist.
-              vmPush(NIL_VAL);
-            }
+          break;
+        }
+        case OBJ_INSTANCE: {
+          // classes may define their own subscript access operator.
+          ObjInstance* instance = AS_INSTANCE(obj);
+          Value getFn = instance->klass->protocol[PROTOCOL_GET];
+          if (!IS_UNDEF(getFn)) {
+            // set up the context for the function call.
+            vmPush(obj);  // receiver.
+            vmPush(key);
+
+            if (!vmCallValue(getFn, 1)) return INTERPRET_RUNTIME_ERROR;
+            frame = vmFrame(vm.frameCount - 1);
             break;
           }
-          default: {
-            vmRuntimeError(
-                "Only objects, sequences, classes, and instances with a '%s' "
-                "method "
-                "support access by subscript.",
-                S_SUBSCRIPT_GET);
-            return INTERPRET_RUNTIME_ERROR;
+
+          // otherwise fall back to property access.
+          uint32_t hash;
+          if (!vmHashValue(key, &hash)) return INTERPRET_RUNTIME_ERROR;
+
+          Value value;
+          if (instanceGetHash(instance, key, &value, hash)) {
+            vmPush(value);
+          } else if (mapGet(&instance->klass->fields, key, &value)) {
+            bindClosure(obj, &value);
+            vmPush(value);
+          } else {
+            // we don't throw an error if the property doesn't exist.
+            vmPush(NIL_VAL);
           }
+          break;
         }
-        break;
-      }
-      case OP_SUBSCRIPT_SET: {
-        if (!IS_OBJ(vmPeek(2))) {
-          vmRuntimeError("Only objects support subscription.");
+        default: {
+          vmRuntimeError(
+              "Only objects, sequences, classes, and instances with a '%s' "
+              "method "
+              "support access by subscript.",
+              S_SUBSCRIPT_GET);
           return INTERPRET_RUNTIME_ERROR;
         }
+      }
+      DISPATCH();
+    }
+    CASE(OP_SUBSCRIPT_SET): {
+      if (!IS_OBJ(vmPeek(2))) {
+        vmRuntimeError("Only objects support subscription.");
+        return INTERPRET_RUNTIME_ERROR;
+      }
 
-        switch (OBJ_TYPE(vmPeek(2))) {
-          case OBJ_SEQUENCE: {
-            ObjSequence* seq = AS_SEQUENCE(vmPeek(2));
+      switch (OBJ_TYPE(vmPeek(2))) {
+        case OBJ_SEQUENCE: {
+          ObjSequence* seq = AS_SEQUENCE(vmPeek(2));
 
-            if (!validateSeqIdx(seq, vmPeek(1))) return INTERPRET_RUNTIME_ERROR;
-            int idx = AS_NUMBER(vmPeek(1));
-            seq->values.values[idx] = vmPeek(0);
+          if (!validateSeqIdx(seq, vmPeek(1))) return INTERPRET_RUNTIME_ERROR;
+          int idx = AS_NUMBER(vmPeek(1));
+          seq->values.values[idx] = vmPeek(0);
+          writeBarrier((Obj*)seq, vmPeek(0));
 
-            // leave the sequence on the stack.
-            vmPop();  // val.
-            vmPop();  // key.
-            break;
-          }
-          case OBJ_STRING: {
-            ObjString* string = AS_STRING(vmPeek(2));
-            if (!validateStrIdx(string, vmPeek(1)))
-              return INTERPRET_RUNTIME_ERROR;
-            int idx = AS_NUMBER(vmPeek(1));
-
-            if (!IS_STRING(vmPeek(0)) && AS_STRING(vmPeek(0))->length == 1) {
-              vmRuntimeError("Must be character.");
-              return false;
-            }
-
-            ObjString* character = AS_STRING(vmPeek(0));
-            setStringChar(string, character, idx);
-            // leave the string on the stack.
-            vmPop();  // val.
-            vmPop();  // key.
-            break;
-          }
-          case OBJ_INSTANCE: {
-            // classes may define their own subscript setting operator.
-            ObjInstance* instance = AS_INSTANCE(vmPeek(2));
-            Value setFn;
-            if (mapGet(&instance->klass->fields, INTERN(S_SUBSCRIPT_SET),
-                       &setFn)) {
-              // the stack is already ready for the function call.
-              if (!vmCallValue(setFn, 2)) return INTERPRET_RUNTIME_ERROR;
-              frame = &vm.frames[vm.frameCount - 1];
-              break;
-            }
-
-            // otherwise fall back to property access.
-            uint32_t hash;
-            if (!vmHashValue(vmPeek(1), &hash)) return INTERPRET_RUNTIME_ERROR;
-
-            mapSetHash(&instance->fields, vmPeek(1), vmPeek(0), hash);
-            // leave the object on the stack.
-            vmPop();  // val.
-            vmPop();  // key.
-            break;
-          }
-          default: {
-            vmRuntimeError(
-                "Only objects, sequences, and instances with a '%s' method "
-                "support assignment by subscript.",
-                S_SUBSCRIPT_SET);
-            return INTERPRET_RUNTIME_ERROR;
-          }
+          // leave the sequence on the stack.
+          vmPop();  // val.
+          vmPop();  // key.
+          break;
         }
+        case OBJ_STRING: {
+          ObjString* string = AS_STRING(vmPeek(2));
+          if (!validateStrIdx(string, vmPeek(1)))
+            return INTERPRET_RUNTIME_ERROR;
+          int idx = AS_NUMBER(vmPeek(1));
 
-        break;
-      }
-      case OP_DESTRUCTURE: {
-        Value value = vmPeek(0);
-        if (!ast(value)) return INTERPRET_RUNTIME_ERROR;
-        break;
-      }
-      case OP_SET_TYPE_LOCAL: {
-        uint8_t slot = READ_SHORT();
-        Value local = frame->slots[slot];
-
-        if (IS_OBJ(local)) {
-          Obj* obj = AS_OBJ(local);
-          writeValueArray(&obj->annotations, vmPeek(0));
-        }
+          if (!IS_STRING(vmPeek(0)) && AS_STRING(vmPeek(0))->length == 1) {
+            vmRuntimeError("Must be character.");
+            return false;
+          }
 
-        break;
-      }
-      case OP_SET_TYPE_GLOBAL: {
-        Value name = READ_CONSTANT();
-        Value global;
-        if (!mapGet(&vm.module->namespace, name, &global) &&
-            !mapGet(&vm.globals, name, &global)) {
-          vmRuntimeError("Undefined variable '%s'.", AS_STRING(name)->chars);
-          return INTERPRET_RUNTIME_ERROR;
+          ObjString* character = AS_STRING(vmPeek(0));
+          setStringChar(string, character, idx);
+          // leave the string on the stack.
+          vmPop();  // val.
+          vmPop();  // key.
+          break;
         }
+        case OBJ_INSTANCE: {
+          // classes may define their own subscript setting operator.
+          ObjInstance* instance = AS_INSTANCE(vmPeek(2));
+          Value setFn = instance->klass->protocol[PROTOCOL_SET];
+          if (!IS_UNDEF(setFn)) {
+            // the stack is already ready for the function call.
+            if (!vmCallValue(setFn, 2)) return INTERPRET_RUNTIME_ERROR;
+            frame = vmFrame(vm.frameCount - 1);
+            break;
+          }
 
-        if (IS_OBJ(global)) {
-          Obj* obj = AS_OBJ(global);
-          writeValueArray(&obj->annotations, vmPeek(0));
+          // otherwise fall back to property access.
+          uint32_t hash;
+          if (!vmHashValue(vmPeek(1), &hash)) return INTERPRET_RUNTIME_ERROR;
+
+          // subscript assignment treats the instance as a dictionary,
+          // so any key, names included, puts it in dictionary mode.
+          mapSetHash(instanceFields(instance), vmPeek(1), vmPeek(0), hash);
+          // leave the object on the stack.
+          vmPop();  // val.
+          vmPop();  // key.
+          break;
         }
-        break;
-      }
-      case OP_SPREAD: {
-        Value value = vmPeek(0);
-
-        ObjClass lca;
-        if (!IS_INSTANCE(value) ||
-            (leastCommonAncestor(AS_INSTANCE(value)->klass, vm.core.sequence,
-                                 &lca) &&
-             &lca == vm.core.sequence)) {
-          vmRuntimeError("Only sequential values can spread.");
+        default: {
+          vmRuntimeError(
+              "Only objects, sequences, and instances with a '%s' method "
+              "support assignment by subscript.",
+              S_SUBSCRIPT_SET);
           return INTERPRET_RUNTIME_ERROR;
         }
-
-        ObjSpread* spread = newSpread(value);
-        vmPop();
-        vmPush(OBJ_VAL(spread));
-        break;
       }
-      case OP_UNIT: {
-        vmPush(UNIT_VAL);
-        break;
-      }
-      case OP_QUANTIFY: {
-        Value body = vmPop();
-        Value restriction = vmPop();
-        Value quantifier = vmPop();
 
-        vmPush(quantifier);
-        vmPush(restriction);
-        vmPush(body);
+      DISPATCH();
+    }
+    CASE(OP_DESTRUCTURE): {
+      Value value = vmPeek(0);
+      if (!ast(value)) return INTERPRET_RUNTIME_ERROR;
+      DISPATCH();
+    }
+    CASE(OP_SET_TYPE_LOCAL): {
+      uint8_t slot = READ_SHORT();
+      Value local = frame->slots[slot];
 
-        if (!vmCallValue(quantifier, 2)) return INTERPRET_RUNTIME_ERROR;
-        frame = &vm.frames[vm.frameCount - 1];
+      if (IS_OBJ(local)) annotateObject(AS_OBJ(local), vmPeek(0));
 
-        break;
-      }
-      default:
-        vmRuntimeError("Unexpected op code: %i", instruction);
+      DISPATCH();
+    }
+    CASE(OP_SET_TYPE_GLOBAL): {
+      MapEntry* global = readGlobal(frame);
+      if (global == NULL) return INTERPRET_RUNTIME_ERROR;
+
+      if (IS_OBJ(global->value))
+        annotateObject(AS_OBJ(global->value), vmPeek(0));
+      DISPATCH();
+    }
+    CASE(OP_SPREAD): {
+      Value value = vmPeek(0);
+
+      if (!IS_INSTANCE(value)) {
+        vmRuntimeError("Only sequential values can spread.");
         return INTERPRET_RUNTIME_ERROR;
+      }
+
+      ObjSpread* spread = newSpread(value);
+      vmPop();
+      vmPush(OBJ_VAL(spread));
+      DISPATCH();
+    }
+    CASE(OP_UNIT): {
+      vmPush(UNIT_VAL);
+      DISPATCH();
     }
+    CASE(OP_QUANTIFY): {
+      Value body = vmPop();
+      Value restriction = vmPop();
+      Value quantifier = vmPop();
+
+      vmPush(quantifier);
+      vmPush(restriction);
+      vmPush(body);
+
+      if (!vmCallValue(quantifier, 2)) return INTERPRET_RUNTIME_ERROR;
+      frame = vmFrame(vm.frameCount - 1);
+
+      DISPATCH();
+    }
+#ifndef COMPUTED_GOTO
+    default:
+      vmRuntimeError("Unexpected op code: %i", instruction);
+      return INTERPRET_RUNTIME_ERROR;
+#endif
   }
+
+#ifdef COMPUTED_GOTO
+L_UNHANDLED:
+#endif
+  vmRuntimeError("Unexpected op code: %i", instruction);
+  return INTERPRET_RUNTIME_ERROR;
+
+#undef BINARY_OP
+#undef BINARY_FALLBACK
+#undef CASE
+#undef DISPATCH
 }
 
 // Compilation routines that use the stack.
@@ -1664,6 +2742,7 @@ ObjModule* vmCompileModule(char* enclosingDir, Token path, ModuleType type) {
   if (closure == NULL) return NULL;
 
   module->closure = closure;
+  writeBarrier((Obj*)module, OBJ_VAL(closure));
 
   vmPop();  // module.
   vmPop();  // objSource.
@@ -1715,6 +2794,7 @@ InterpretResult executeMain(char* path) {
                                          vm.core.sExecMain->chars, vm.module);
   if (closure == NULL) return INTERPRET_COMPILE_ERROR;
   mainModule->closure = closure;
+  writeBarrier((Obj*)mainModule, OBJ_VAL(closure));
 
   vm.module = mainModule;
   return vmExecuteModule(mainModule);
@@ -6,9 +6,20 @@
 #include "object.h"
 #include "value.h"
 
-#define FRAMES_MAX 2000
-#define STACK_MAX (FRAMES_MAX * UINT8_COUNT)
+// the default ceiling on frames, which also bounds the value
+// stack at [UINT8_COUNT] values a frame.
+#define FRAMES_MAX 65536
+// frames are allocated this many at a time, in segments that
+// never move, so a [CallFrame*] stays put as the stack deepens.
+#define FRAMES_SEGMENT 64
+// the value stack starts out with room for this many values,
+// and grows whenever a frame is pushed to fit what its code can
+// push, with [STACK_FRAME] to spare.
+#define STACK_INITIAL (UINT8_COUNT * 4)
+#define STACK_FRAME (UINT8_COUNT * 2)
 #define COMPREHENSION_DEPTH_MAX UINT8_MAX
+// the number of range types cached for annotated callees.
+#define INSTANTIATIONS 256
 
 #define READ_BYTE() (*frame->ip++)
 #define READ_SHORT() \
@@ -17,12 +28,18 @@
   (frame->closure->function->chunk.constants.values[READ_SHORT()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
 
+// Dispatch through a table of label addresses where the compiler
+// supports it, falling back to a switch everywhere else.
+#if defined(__GNUC__) && !defined(NAT_SWITCH_DISPATCH)
+#define COMPUTED_GOTO
+#endif
+
 #ifdef DEBUG_TRACE_EXECUTION
 #define TRACE_EXECUTION(tape)                                     \
   do {                                                            \
     printf("          ");                                         \
     disassembleStack();                                           \
-    printf(tape);                                                 \
+    printf("%s", tape);                                           \
     printf("\n");                                                 \
     printf("  ");                                                 \
     disassembleInstruction(                                       \
@@ -35,23 +52,58 @@
   } while (0)
 #endif
 
+// What the dispatch loop does with a frame when it returns.
+typedef enum {
+  // push the return value for the caller.
+  FRAME_CALL,
+  // push the return value and annotate it with the
+  // type sitting beneath the callee.
+  FRAME_ANNOTATED_CALL,
+  // discard the return value and close the comprehension.
+  FRAME_COMPREHENSION,
+  // discard the return value, restore the enclosing
+  // module, and merge the imported namespace into it.
+  FRAME_IMPORT,
+} FrameType;
+
 typedef struct {
   ObjClosure* closure;
   uint8_t* ip;
   Value* slots;
+  FrameType type;
+  // the module that was executing when an import frame was pushed.
+  ObjModule* enclosing;
 } CallFrame;
 
+// the range type instantiated for an annotated [callee]
+// applied to arguments with the key's descriptors.
+typedef struct {
+  Value callee;
+  // the callee's annotation count and the vm's dispatch
+  // epoch when the type was instantiated.
+  int annotationCount;
+  int epoch;
+  DispatchKey key;
+  Value type;
+} Instantiation;
+
 typedef struct {
   ObjString* sName;
   ObjString* sArity;
   ObjString* sPatterned;
   ObjString* sVariadic;
   ObjString* sValues;
+  ObjString* sSeq;
+  ObjString* sIdx;
+  ObjString* sEnd;
   ObjString* sSignature;
   ObjString* sFunction;
   ObjString* sModule;
   ObjString* sQuote;
   ObjString* sBackslash;
+  ObjString* sInner;
+  // the names of the protocol methods, by slot.
+  ObjString* protocols[PROTOCOL_COUNT];
 
   ObjString* sMain;
   ObjString* sExecMain;
@@ -65,6 +117,7 @@ typedef struct {
   ObjClass* map;
   ObjClass* set;
   ObjClass* generator;
+  ObjClass* iterator;
 
   ObjClass* astClosure;
   ObjClass* astComprehension;
@@ -101,15 +154,21 @@ typedef struct {
 
 typedef struct {
   // stack.
-  Value stack[STACK_MAX];
+  Value* stack;
   Value* stackTop;
-  CallFrame frames[FRAMES_MAX];
+  int stackCapacity;
+  CallFrame** frames;
+  int frameSegments;
   int frameCount;
+  int framesMax;
 
-  // heap.
+  // heap. objects start out young and are promoted
+  // to the old generation when they survive a collection.
   Obj* objects;
+  Obj* young;
   ObjUpvalue* openUpvalues;
   ObjMap strings;
+  AnnotationTable annotations;
   ObjMap globals;
   ObjMap typeEnv;
   ObjMap prefixes;
@@ -126,8 +185,14 @@ typedef struct {
   int grayCount;
   int grayCapacity;
   Obj** grayStack;
+  // the old objects and maps written a young reference
+  // since the last collection.
+  int rememberedCount;
+  int rememberedCapacity;
+  Obj** remembered;
   size_t bytesAllocated;
   size_t nextGC;
+  size_t nextYoungGC;
 
   // root compiler.
   Compiler* compiler;
@@ -135,6 +200,18 @@ typedef struct {
   // currently executing module.
   ObjModule* module;
 
+  // cleared once a global definition or assignment
+  // rebinds one of the operators with its own instruction.
+  bool nativeOperators;
+
+  // bumped to empty every dispatch cache. once literals can have
+  // types of their own, dispatch keys on values rather than types.
+  int dispatchEpoch;
+  bool dispatchByValue;
+
+  // a direct-mapped cache, by callee and argument types.
+  Instantiation instantiations[INSTANTIATIONS];
+
   int comprehensionDepth;
   Obj* comprehensions[COMPREHENSION_DEPTH_MAX];
 } VM;
@@ -147,6 +224,11 @@ typedef enum {
 
 extern VM vm;
 
+// The frame [depth] frames from the bottom of the frame stack.
+static inline CallFrame* vmFrame(int depth) {
+  return &vm.frames[depth / FRAMES_SEGMENT][depth % FRAMES_SEGMENT];
+}
+
 bool initVM();
 void freeVM();
 
@@ -169,10 +251,11 @@ void vmPush(Value value);
 Value vmPop();
 Value vmPeek(int distance);
 bool vmInitInstance(ObjClass* klass, int argCount);
+void vmClassSet(ObjClass* klass, Value name, Value value);
 bool vmInvoke(ObjString* name, int argCount);
 bool vmExecuteMethod(char* method, int argCount);
 bool vmHashValue(Value value, uint32_t* hash);
-void vmInitFrame(ObjClosure* closure, int offset);
+bool vmInitFrame(ObjClosure* closure, int offset);
 bool vmCallValue(Value value, int argCount);
 void vmCloseUpvalues(Value* last);
 void vmClosure(CallFrame* frame);
@@ -181,6 +264,8 @@ void vmVariable(CallFrame* frame);
 void vmSign(CallFrame* frame);
 bool vmSequenceValueField(ObjInstance* obj, Value* seq);
 bool vmTuplify(int count, bool replace);
-ObjUpvalue* vmCaptureUpvalue(Value* local, uint8_t slot, ObjString* name);
+void vmPushSequence(Value* values, int count);
+ObjUpvalue* vmCaptureUpvalue(Value* local, uint8_t slot, int offset,
+                             ObjFunction* function);
 
 #endif